@@ -0,0 +1,231 @@
+#include "common.h"
+#include "vbuffer.h"
+#include "vmemory.h"
+
+#include <string.h>
+
+static const char *sample_name = "Dedicated allocation benchmark";
+
+#define BENCH_ITERATIONS    5
+#define BENCH_FILL_REPEATS  4
+
+typedef struct BenchSizeClass
+{
+    VkDeviceSize size;
+    uint32_t count;
+} BenchSizeClass;
+
+typedef struct BenchResult
+{
+    double createMs;
+    double destroyMs;
+    double fillGpuMs;
+    uint32_t failedCount;
+} BenchResult;
+
+// Mix of small buffers which are always sub-allocated and large ones which hit the dedicated threshold
+static const BenchSizeClass sizeClasses[] = {
+    { 256ull * 1024, 128 },
+    { 4ull * 1024 * 1024, 32 },
+    { 40ull * 1024 * 1024, 8 },
+    { 128ull * 1024 * 1024, 2 }
+};
+
+#define BENCH_SIZE_CLASS_COUNT (sizeof(sizeClasses) / sizeof(sizeClasses[0]))
+
+void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFlight)
+{
+}
+
+void destroy_auxiliary(MyRenderContext *context)
+{
+}
+
+static double get_elapsed_ms(uint64_t startTick)
+{
+    return (double)(SDL_GetPerformanceCounter() - startTick) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void measure_fill(MyRenderContext *context, VkQueryPool queryPool, VBuffer *buffers, uint32_t classIndex,
+    uint32_t firstBuffer, BenchResult *result)
+{
+    VkResult r;
+    VkCommandBufferAllocateInfo allocInfo = {0};
+    VkCommandBufferBeginInfo beginInfo = {0};
+    VkSubmitInfo2 submitInfo = {0};
+    VkCommandBufferSubmitInfo commandBufferInfo = {0};
+    VkFenceCreateInfo fenceInfo = {0};
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    uint64_t timestamps[2];
+
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = context->commandPool;
+    allocInfo.commandBufferCount = 1;
+    CHECK_VK(vkAllocateCommandBuffers(context->logicalDevice, &allocInfo, &commandBuffer));
+
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    CHECK_VK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 0);
+
+    for (uint32_t repeat = 0; repeat < BENCH_FILL_REPEATS; repeat++)
+    {
+        for (uint32_t i = 0; i < sizeClasses[classIndex].count; i++)
+        {
+            if (buffers[firstBuffer + i].buffer)
+            {
+                vkCmdFillBuffer(commandBuffer, buffers[firstBuffer + i].buffer, 0, VK_WHOLE_SIZE, repeat);
+            }
+        }
+    }
+
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 1);
+    CHECK_VK(vkEndCommandBuffer(commandBuffer));
+
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    CHECK_VK(vkCreateFence(context->logicalDevice, &fenceInfo, context->allocationCallbacks, &fence));
+
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    commandBufferInfo.commandBuffer = commandBuffer;
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    CHECK_VK(vkQueueSubmit2(context->graphicsQueue.queue, 1, &submitInfo, fence));
+    CHECK_VK(vkWaitForFences(context->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+
+    CHECK_VK(vkGetQueryPoolResults(context->logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    result->fillGpuMs += (double)(timestamps[1] - timestamps[0]) * context->supportedFeatures.limits.timestampPeriod / 1000000.0;
+
+    vkDestroyFence(context->logicalDevice, fence, context->allocationCallbacks);
+    vkFreeCommandBuffers(context->logicalDevice, context->commandPool, 1, &commandBuffer);
+}
+
+static void run_benchmark(MyRenderContext *context, VkQueryPool queryPool, uint32_t policy, BenchResult *results)
+{
+    VBuffer *buffers;
+    uint32_t bufferCount = 0, firstBuffer;
+    uint64_t startTick;
+
+    for (uint32_t i = 0; i < BENCH_SIZE_CLASS_COUNT; i++)
+    {
+        bufferCount += sizeClasses[i].count;
+    }
+
+    buffers = calloc(bufferCount, sizeof(VBuffer));
+    context->memoryAllocator.dedicatedPolicy = policy;
+    memset(results, 0, sizeof(BenchResult) * BENCH_SIZE_CLASS_COUNT);
+
+    for (uint32_t iteration = 0; iteration < BENCH_ITERATIONS; iteration++)
+    {
+        firstBuffer = 0;
+        for (uint32_t i = 0; i < BENCH_SIZE_CLASS_COUNT; i++)
+        {
+            startTick = SDL_GetPerformanceCounter();
+            for (uint32_t j = 0; j < sizeClasses[i].count; j++)
+            {
+                buffers[firstBuffer + j] = create_vulkan_buffer(context, sizeClasses[i].size,
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                results[i].failedCount += buffers[firstBuffer + j].buffer ? 0 : 1;
+            }
+
+            results[i].createMs += get_elapsed_ms(startTick);
+            firstBuffer += sizeClasses[i].count;
+        }
+
+        firstBuffer = 0;
+        for (uint32_t i = 0; i < BENCH_SIZE_CLASS_COUNT; i++)
+        {
+            measure_fill(context, queryPool, buffers, i, firstBuffer, results + i);
+            firstBuffer += sizeClasses[i].count;
+        }
+
+        if (iteration == 0)
+        {
+            print_vulkan_memory_stats(context);
+        }
+
+        firstBuffer = 0;
+        for (uint32_t i = 0; i < BENCH_SIZE_CLASS_COUNT; i++)
+        {
+            startTick = SDL_GetPerformanceCounter();
+            for (uint32_t j = 0; j < sizeClasses[i].count; j++)
+            {
+                if (buffers[firstBuffer + j].buffer)
+                {
+                    destroy_vulkan_buffer(context, buffers[firstBuffer + j]);
+                }
+            }
+
+            results[i].destroyMs += get_elapsed_ms(startTick);
+            firstBuffer += sizeClasses[i].count;
+        }
+    }
+
+    free(buffers);
+}
+
+static void print_results(const char *policyName, const BenchResult *results)
+{
+    printf("%s policy, average of %d iterations:\n", policyName, BENCH_ITERATIONS);
+    for (uint32_t i = 0; i < BENCH_SIZE_CLASS_COUNT; i++)
+    {
+        printf("\t%3u x %6llu KB: create %8.3f ms, destroy %8.3f ms, GPU fill x%d %8.3f ms, failed %.2f\n",
+            sizeClasses[i].count, (unsigned long long)(sizeClasses[i].size / 1024),
+            results[i].createMs / BENCH_ITERATIONS, results[i].destroyMs / BENCH_ITERATIONS,
+            BENCH_FILL_REPEATS, results[i].fillGpuMs / BENCH_ITERATIONS, (double)results[i].failedCount / BENCH_ITERATIONS);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    VkResult r;
+    uint32_t flags = SAMPLE_HOST_MEMORY_POOL;
+    MyRenderContext context = {0};
+    VkQueryPoolCreateInfo queryPoolInfo = {0};
+    VkQueryPool queryPool;
+    BenchResult heuristicResults[BENCH_SIZE_CLASS_COUNT];
+    BenchResult subAllocatedResults[BENCH_SIZE_CLASS_COUNT];
+
+    context.sampleName = sample_name;
+    printf("Starting %s ...\n", context.sampleName);
+
+    init_sdl2();
+
+    create_sdl2_vulkan_window(&context, flags);
+    create_sdl2_vulkan_instance(&context, flags);
+    create_sdl2_vulkan_surface(&context);
+    choose_vulkan_physical_device(&context, flags);
+    create_vulkan_logical_device(&context);
+    create_vulkan_swapchain(&context);
+    create_vulkan_command_buffers(&context);
+
+    if (!context.supportedFeatures.limits.timestampComputeAndGraphics)
+    {
+        fprintf(stderr, "Timestamp queries are not supported by the graphics queue\n");
+        destroy_context(&context);
+        return 1;
+    }
+
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+    CHECK_VK(vkCreateQueryPool(context.logicalDevice, &queryPoolInfo, context.allocationCallbacks, &queryPool));
+
+    // Warm up, the first blocks of each memory type are kept alive by the allocator
+    run_benchmark(&context, queryPool, DEDICATED_POLICY_REQUIRED, subAllocatedResults);
+
+    run_benchmark(&context, queryPool, DEDICATED_POLICY_REQUIRED, subAllocatedResults);
+    run_benchmark(&context, queryPool, DEDICATED_POLICY_HEURISTIC, heuristicResults);
+
+    print_results("Sub-allocated (dedicated only if required)", subAllocatedResults);
+    print_results("Heuristic (driver preference or size threshold)", heuristicResults);
+
+    vkDestroyQueryPool(context.logicalDevice, queryPool, context.allocationCallbacks);
+    destroy_context(&context);
+    return 0;
+}
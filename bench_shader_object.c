@@ -0,0 +1,371 @@
+#include "common.h"
+#include "pipeline_state.h"
+#include "shader_object.h"
+#include "vmemory.h"
+
+#include <string.h>
+
+static const char *sample_name = "Shader object benchmark";
+
+#define BENCH_ITERATIONS    5
+#define BENCH_DRAW_COUNT    10000
+#define BENCH_TARGET_SIZE   256
+// Cull mode x front face, the pipeline path needs a pipeline for each of them
+#define BENCH_STATE_COUNT   8
+
+#define BENCH_MODE_PIPELINES        0 // vkCmdBindPipeline before every draw
+#define BENCH_MODE_DYNAMIC_STATE    1 // one pipeline with the dynamic state of the samples set once, cull mode and front face
+                                      // set again before every draw
+#define BENCH_MODE_SHADER_STATE     2 // shaders bound once, cull mode and front face set before every draw
+#define BENCH_MODE_SHADER_REBIND    3 // shaders and the whole state bound before every draw
+#define BENCH_MODE_COUNT            4
+
+typedef struct BenchTarget
+{
+    VkImage image;
+    VkImageView imageView;
+    MyMemoryAllocation allocation;
+    VkExtent2D extent;
+} BenchTarget;
+
+typedef struct BenchResult
+{
+    double recordMs;
+    double gpuMs;
+} BenchResult;
+
+static const char *modeNames[BENCH_MODE_COUNT] = {
+    "Pipelines, bind per draw",
+    "Pipeline, dynamic state per draw",
+    "Shader objects, state per draw",
+    "Shader objects, bind per draw"
+};
+
+void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFlight)
+{
+}
+
+void destroy_auxiliary(MyRenderContext *context)
+{
+}
+
+static double get_elapsed_ms(uint64_t startTick)
+{
+    return (double)(SDL_GetPerformanceCounter() - startTick) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void describe_bench_pipeline(MyRenderContext *context, uint32_t stateIndex, MyPipelineDesc *desc)
+{
+    init_vulkan_pipeline_desc(context, desc);
+    add_vulkan_pipeline_shader(desc, VK_SHADER_STAGE_VERTEX_BIT, "base.vert");
+    add_vulkan_pipeline_shader(desc, VK_SHADER_STAGE_FRAGMENT_BIT, "base.frag");
+    add_vulkan_pipeline_push_constants(desc, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MyShaderUniforms));
+    desc->cullMode = stateIndex % 4; // none, front, back, front and back
+    desc->frontFace = stateIndex / 4 ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+}
+
+static void create_bench_target(MyRenderContext *context, BenchTarget *target)
+{
+    VkResult r;
+    VkImageCreateInfo imageInfo = {0};
+    VkImageViewCreateInfo viewInfo = {0};
+    VkMemoryRequirements memRequirements;
+
+    target->extent.width = BENCH_TARGET_SIZE;
+    target->extent.height = BENCH_TARGET_SIZE;
+
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = context->surfaceFormat.format;
+    imageInfo.extent.width = target->extent.width;
+    imageInfo.extent.height = target->extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    CHECK_VK(vkCreateImage(context->logicalDevice, &imageInfo, context->allocationCallbacks, &target->image));
+
+    vkGetImageMemoryRequirements(context->logicalDevice, target->image, &memRequirements);
+    if (!allocate_vulkan_memory(context, &memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_FALSE, NULL, &target->allocation))
+    {
+        fprintf(stderr, "Failed to allocate the benchmark render target\n");
+        exit(1);
+    }
+
+    CHECK_VK(vkBindImageMemory(context->logicalDevice, target->image, target->allocation.memory, target->allocation.offset));
+
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = target->image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    CHECK_VK(vkCreateImageView(context->logicalDevice, &viewInfo, context->allocationCallbacks, &target->imageView));
+}
+
+static void destroy_bench_target(MyRenderContext *context, BenchTarget *target)
+{
+    vkDestroyImageView(context->logicalDevice, target->imageView, context->allocationCallbacks);
+    vkDestroyImage(context->logicalDevice, target->image, context->allocationCallbacks);
+    free_vulkan_memory(context, &target->allocation);
+}
+
+// pipelines has a pipeline for each state and the pipeline with the dynamic state last
+static void record_draws(MyRenderContext *context, VkCommandBuffer commandBuffer, uint32_t mode, const VkPipeline *pipelines,
+    VkPipelineLayout layout, const MyPipelineDesc *state, const VkViewport *viewport, const VkRect2D *scissor)
+{
+    MyShaderObjects *objects = &context->shaderObjects;
+
+    if (mode == BENCH_MODE_SHADER_STATE)
+    {
+        bind_vulkan_shader_objects(commandBuffer, objects, state, viewport, scissor);
+    }
+    else if (mode == BENCH_MODE_PIPELINES || mode == BENCH_MODE_DYNAMIC_STATE)
+    {
+        vkCmdSetViewport(commandBuffer, 0, 1, viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, scissor);
+    }
+
+    if (mode == BENCH_MODE_DYNAMIC_STATE)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[BENCH_STATE_COUNT]);
+        // Topology and, with VK_EXT_extended_dynamic_state3, polygon mode and blending are dynamic too
+        set_vulkan_pipeline_dynamic_state(commandBuffer, state);
+    }
+
+    vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MyShaderUniforms), &context->shaderUniforms);
+
+    for (uint32_t i = 0; i < BENCH_DRAW_COUNT; i++)
+    {
+        uint32_t stateIndex = i % BENCH_STATE_COUNT;
+
+        if (mode == BENCH_MODE_PIPELINES)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[stateIndex]);
+        }
+        else
+        {
+            if (mode == BENCH_MODE_SHADER_REBIND)
+            {
+                bind_vulkan_shader_objects(commandBuffer, objects, state, viewport, scissor);
+            }
+
+            vkCmdSetCullMode(commandBuffer, stateIndex % 4);
+            vkCmdSetFrontFace(commandBuffer, stateIndex / 4 ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        }
+
+        vkCmdDraw(commandBuffer, 18, 1, 0, 0);
+    }
+}
+
+static void measure_draws(MyRenderContext *context, VkQueryPool queryPool, const BenchTarget *target, uint32_t mode,
+    const VkPipeline *pipelines, VkPipelineLayout layout, const MyPipelineDesc *state, BenchResult *result)
+{
+    VkResult r;
+    VkCommandBufferAllocateInfo allocInfo = {0};
+    VkCommandBufferBeginInfo beginInfo = {0};
+    VkRenderingAttachmentInfo renderingAttachment = {0};
+    VkRenderingInfo renderingInfo = {0};
+    VkImageMemoryBarrier2 imageLayoutBarrier = {0};
+    VkDependencyInfo dependencyInfo = {0};
+    VkSubmitInfo2 submitInfo = {0};
+    VkCommandBufferSubmitInfo commandBufferInfo = {0};
+    VkFenceCreateInfo fenceInfo = {0};
+    VkViewport viewport = {0};
+    VkRect2D scissor = {0};
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    uint64_t timestamps[2];
+    uint64_t startTick;
+
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = context->commandPool;
+    allocInfo.commandBufferCount = 1;
+    CHECK_VK(vkAllocateCommandBuffers(context->logicalDevice, &allocInfo, &commandBuffer));
+
+    renderingAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    renderingAttachment.imageView = target->imageView;
+    renderingAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    renderingAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    renderingAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea.extent = target->extent;
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &renderingAttachment;
+
+    // The previous contents are not needed, undefined -> color attachment optimal on every run
+    imageLayoutBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    imageLayoutBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageLayoutBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    imageLayoutBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    imageLayoutBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    imageLayoutBarrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    imageLayoutBarrier.image = target->image;
+    imageLayoutBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageLayoutBarrier.subresourceRange.levelCount = 1;
+    imageLayoutBarrier.subresourceRange.layerCount = 1;
+
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = 1;
+    dependencyInfo.pImageMemoryBarriers = &imageLayoutBarrier;
+
+    viewport.width = (float)target->extent.width;
+    viewport.height = (float)target->extent.height;
+    viewport.maxDepth = 1.0f;
+    scissor.extent = target->extent;
+
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    // Only the draw loop is timed on the CPU, the GPU time covers the whole rendering
+    CHECK_VK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 0);
+    vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+    startTick = SDL_GetPerformanceCounter();
+    record_draws(context, commandBuffer, mode, pipelines, layout, state, &viewport, &scissor);
+    result->recordMs += get_elapsed_ms(startTick);
+
+    vkCmdEndRendering(commandBuffer);
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 1);
+    CHECK_VK(vkEndCommandBuffer(commandBuffer));
+
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    CHECK_VK(vkCreateFence(context->logicalDevice, &fenceInfo, context->allocationCallbacks, &fence));
+
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    commandBufferInfo.commandBuffer = commandBuffer;
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    CHECK_VK(vkQueueSubmit2(context->graphicsQueue.queue, 1, &submitInfo, fence));
+    CHECK_VK(vkWaitForFences(context->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+
+    CHECK_VK(vkGetQueryPoolResults(context->logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    result->gpuMs += (double)(timestamps[1] - timestamps[0]) * context->supportedFeatures.limits.timestampPeriod / 1000000.0;
+
+    vkDestroyFence(context->logicalDevice, fence, context->allocationCallbacks);
+    vkFreeCommandBuffers(context->logicalDevice, context->commandPool, 1, &commandBuffer);
+}
+
+int main(int argc, char **argv)
+{
+    VkResult r;
+    uint32_t flags = SAMPLE_HOST_MEMORY_POOL;
+    MyRenderContext context = {0};
+    VkQueryPoolCreateInfo queryPoolInfo = {0};
+    VkQueryPool queryPool;
+    BenchTarget target = {0};
+    MyPipelineDesc desc;
+    MyPipelineId pipelineIds[BENCH_STATE_COUNT];
+    VkPipeline pipelines[BENCH_STATE_COUNT + 1];
+    VkPipelineLayout layout;
+    BenchResult results[BENCH_MODE_COUNT];
+    double pipelineStartupMs, dynamicStartupMs, shaderObjectStartupMs;
+    uint64_t startTick;
+
+    context.sampleName = sample_name;
+    printf("Starting %s ...\n", context.sampleName);
+
+    init_sdl2();
+
+    create_sdl2_vulkan_window(&context, flags);
+    create_sdl2_vulkan_instance(&context, flags);
+    create_sdl2_vulkan_surface(&context);
+    choose_vulkan_physical_device(&context, flags);
+    create_vulkan_logical_device(&context);
+    create_vulkan_swapchain(&context);
+    create_vulkan_command_buffers(&context);
+
+    if (!context.supportedFeatures.shaderObjectSupport)
+    {
+        fprintf(stderr, "VK_EXT_shader_object is not supported\n");
+        destroy_context(&context);
+        return 1;
+    }
+
+    if (!context.supportedFeatures.limits.timestampComputeAndGraphics)
+    {
+        fprintf(stderr, "Timestamp queries are not supported by the graphics queue\n");
+        destroy_context(&context);
+        return 1;
+    }
+
+    // Startup, every state combination needs its own pipeline while the shader objects cover all of them.
+    // The pipelines go through the pipeline cache of the previous run, delete it for cold numbers.
+    startTick = SDL_GetPerformanceCounter();
+    for (uint32_t i = 0; i < BENCH_STATE_COUNT; i++)
+    {
+        describe_bench_pipeline(&context, i, &desc);
+        pipelineIds[i] = request_vulkan_pipeline(&context, &desc);
+    }
+
+    for (uint32_t i = 0; i < BENCH_STATE_COUNT; i++)
+    {
+        pipelines[i] = get_vulkan_pipeline(&context, pipelineIds[i]);
+    }
+
+    pipelineStartupMs = get_elapsed_ms(startTick);
+    layout = get_vulkan_pipeline_layout(&context, pipelineIds[0]);
+
+    describe_bench_pipeline(&context, 0, &desc);
+    add_vulkan_pipeline_dynamic_states(&context, &desc);
+    startTick = SDL_GetPerformanceCounter();
+    pipelines[BENCH_STATE_COUNT] = get_vulkan_pipeline(&context, request_vulkan_pipeline(&context, &desc));
+    dynamicStartupMs = get_elapsed_ms(startTick);
+
+    startTick = SDL_GetPerformanceCounter();
+    if (!create_vulkan_shader_objects(&context, &desc, &context.shaderObjects))
+    {
+        destroy_context(&context);
+        return 1;
+    }
+
+    shaderObjectStartupMs = get_elapsed_ms(startTick);
+
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+    CHECK_VK(vkCreateQueryPool(context.logicalDevice, &queryPoolInfo, context.allocationCallbacks, &queryPool));
+    create_bench_target(&context, &target);
+    context.shaderUniforms.aspect = 1.0f;
+
+    memset(results, 0, sizeof(results));
+    for (uint32_t mode = 0; mode < BENCH_MODE_COUNT; mode++)
+    {
+        // Warm up, the driver may compile state variants on the first use
+        BenchResult warmUp = {0};
+
+        measure_draws(&context, queryPool, &target, mode, pipelines, layout, &desc, &warmUp);
+        for (uint32_t iteration = 0; iteration < BENCH_ITERATIONS; iteration++)
+        {
+            measure_draws(&context, queryPool, &target, mode, pipelines, layout, &desc, results + mode);
+        }
+    }
+
+    printf("Startup: %u pipelines %8.3f ms, pipeline with dynamic state %8.3f ms, shader objects %8.3f ms\n", BENCH_STATE_COUNT,
+        pipelineStartupMs, dynamicStartupMs, shaderObjectStartupMs);
+    printf("%d draws switching between %d states, average of %d iterations:\n", BENCH_DRAW_COUNT, BENCH_STATE_COUNT, BENCH_ITERATIONS);
+    for (uint32_t mode = 0; mode < BENCH_MODE_COUNT; mode++)
+    {
+        printf("\t%-32s record %8.3f ms (%6.1f ns per draw), GPU %8.3f ms\n", modeNames[mode],
+            results[mode].recordMs / BENCH_ITERATIONS, results[mode].recordMs * 1000000.0 / BENCH_ITERATIONS / BENCH_DRAW_COUNT,
+            results[mode].gpuMs / BENCH_ITERATIONS);
+    }
+
+    destroy_bench_target(&context, &target);
+    vkDestroyQueryPool(context.logicalDevice, queryPool, context.allocationCallbacks);
+    destroy_context(&context);
+    return 0;
+}
@@ -0,0 +1,65 @@
+# Converts compiled SPIR-V binaries into uint32_t arrays and a lookup table by shader name.
+#
+# Usage: cmake -DSPIRV_FILES=a.vert.spv,b.frag.spv -DVARIANTS_MANIFEST=shader_variants.txt -DOUTPUT_FILE=shaders_embedded.c
+#        -P embed_spirv.cmake
+#
+# The list is comma separated because semicolons are split by add_custom_command.
+# Shader names are the file names without the .spv suffix, like "base.vert".
+# The variants of the manifest written by add_shader_variant become a second table.
+
+string(REPLACE "," ";" SPIRV_FILES "${SPIRV_FILES}")
+
+set(EMBEDDED_SOURCE "// Generated by embed_spirv.cmake, do not edit\n#include \"shader_io.h\"\n\n")
+set(EMBEDDED_TABLE "")
+
+foreach(SPIRV_FILE ${SPIRV_FILES})
+    get_filename_component(SHADER_NAME ${SPIRV_FILE} NAME)
+    string(REGEX REPLACE "\\.spv$" "" SHADER_NAME ${SHADER_NAME})
+    string(MAKE_C_IDENTIFIER ${SHADER_NAME} SHADER_SYMBOL)
+
+    file(READ ${SPIRV_FILE} SPIRV_HEX HEX)
+    # SPIR-V words are little endian in the file, 8 words per line
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])" "0x\\4\\3\\2\\1, " SPIRV_WORDS "${SPIRV_HEX}")
+    string(REGEX REPLACE "((0x[0-9a-f]+, ){8})" "\\1\n    " SPIRV_WORDS "${SPIRV_WORDS}")
+
+    string(APPEND EMBEDDED_SOURCE "static const uint32_t ${SHADER_SYMBOL}_spv[] = {\n    ${SPIRV_WORDS}\n};\n\n")
+    string(APPEND EMBEDDED_TABLE "    { \"${SHADER_NAME}\", ${SHADER_SYMBOL}_spv, sizeof(${SHADER_SYMBOL}_spv) },\n")
+endforeach()
+
+string(APPEND EMBEDDED_SOURCE "const MyEmbeddedShader embeddedShaders[] = {\n${EMBEDDED_TABLE}};\n\n")
+string(APPEND EMBEDDED_SOURCE "const uint32_t embeddedShaderCount = sizeof(embeddedShaders) / sizeof(embeddedShaders[0]);\n")
+
+# Manifest lines: shader variant cost requires defines, lists are comma separated or -
+set(VARIANT_TABLE "")
+set(VARIANT_COUNT 0)
+if (VARIANTS_MANIFEST)
+    file(STRINGS ${VARIANTS_MANIFEST} VARIANT_LINES REGEX "^[^#]")
+endif()
+
+foreach(VARIANT_LINE ${VARIANT_LINES})
+    string(REPLACE " " ";" VARIANT_FIELDS "${VARIANT_LINE}")
+    list(GET VARIANT_FIELDS 0 VARIANT_SHADER)
+    list(GET VARIANT_FIELDS 1 VARIANT_NAME)
+    list(GET VARIANT_FIELDS 2 VARIANT_COST)
+    list(GET VARIANT_FIELDS 3 VARIANT_REQUIRES)
+
+    set(VARIANT_FEATURES "0")
+    if (NOT VARIANT_REQUIRES STREQUAL "-")
+        string(REPLACE "," ";" VARIANT_REQUIRES "${VARIANT_REQUIRES}")
+        list(TRANSFORM VARIANT_REQUIRES PREPEND "SHADER_FEATURE_")
+        string(JOIN " | " VARIANT_FEATURES ${VARIANT_REQUIRES})
+    endif()
+
+    string(APPEND VARIANT_TABLE "    { \"${VARIANT_SHADER}\", \"${VARIANT_NAME}\", ${VARIANT_COST}, ${VARIANT_FEATURES} },\n")
+    math(EXPR VARIANT_COUNT "${VARIANT_COUNT} + 1")
+endforeach()
+
+# C99 has no empty initializer lists, the count stays 0 without variants
+if (VARIANT_COUNT EQUAL 0)
+    set(VARIANT_TABLE "    { NULL, NULL, 0, 0 },\n")
+endif()
+
+string(APPEND EMBEDDED_SOURCE "\nconst MyShaderVariant embeddedShaderVariants[] = {\n${VARIANT_TABLE}};\n\n")
+string(APPEND EMBEDDED_SOURCE "const uint32_t embeddedShaderVariantCount = ${VARIANT_COUNT};\n")
+
+file(WRITE ${OUTPUT_FILE} "${EMBEDDED_SOURCE}")
@@ -1,7 +1,19 @@
 #include "common.h"
+#include "vmemory.h"
+#include "vbuffer.h"
+#include "host_memory.h"
+#include "pipeline_cache.h"
+#include "pipeline_builder.h"
+#include "pipeline_state.h"
+#include "shader_object.h"
+#include "shader_watch.h"
+#include "deferred_destroy.h"
+#include "record_workers.h"
 
 #include <string.h>
 
+#define FRAMES_IN_FLIGHT_ENV "VK_BEGINNER_FRAMES_IN_FLIGHT"
+
 static const char *VK_LAYER_KHRONOS_validation_name = "VK_LAYER_KHRONOS_validation";
 
 void init_sdl2(void)
@@ -279,14 +291,14 @@ static void create_vulkan_instance(MyRenderContext *context, const VkApplication
     instInfo.enabledExtensionCount = extensionsCount;
     instInfo.ppEnabledExtensionNames = extensions;
 
-    CHECK_VK(vkCreateInstance(&instInfo, NULL, &context->instance));
+    CHECK_VK(vkCreateInstance(&instInfo, context->allocationCallbacks, &context->instance));
     // Load instance-level functions (must be after vkCreateInstance!)
     volkLoadInstance(context->instance);
 
     // Create debug messenger if supported
     if (debugCreateInfo.sType)
     {
-        vkCreateDebugUtilsMessengerEXT(context->instance, &debugCreateInfo, NULL, &context->debugUtilsMessenger);
+        vkCreateDebugUtilsMessengerEXT(context->instance, &debugCreateInfo, context->allocationCallbacks, &context->debugUtilsMessenger);
     }
 }
 
@@ -295,7 +307,7 @@ void create_sdl2_vulkan_window(MyRenderContext *context, uint32_t flags)
     SDL_DisplayMode displayMode;
     int displayIndex = 0;
     int width = INITIAL_WINDOW_WIDTH, height = INITIAL_WINDOW_HEIGHT;
-    uint32_t windowFlags = SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN | SDL_WINDOW_ALLOW_HIGHDPI;
+    uint32_t windowFlags = SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE;
 
     if (SDL_GetDesktopDisplayMode(displayIndex, &displayMode) != 0)
     {
@@ -348,6 +360,9 @@ void create_sdl2_vulkan_instance(MyRenderContext *context, uint32_t flags)
         exit(1);
     }
 
+    // All Vulkan host allocations of the sample go through our allocator
+    create_vulkan_host_allocator(context, flags & SAMPLE_HOST_MEMORY_POOL ? VK_TRUE : VK_FALSE);
+
     print_vulkan_version();
     check_vulkan_instance_features_support(context);
 
@@ -548,6 +563,8 @@ static int check_physical_device_extensions_support(MyRenderContext *context, Vk
     uint32_t extensionCount;
     VkExtensionProperties *extensions = NULL;
     uint8_t swapchainSupport = VK_FALSE;
+    uint8_t graphicsPipelineLibrarySupport = VK_FALSE;
+    uint8_t pipelineLibrarySupport = VK_FALSE;
 
     vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL);
     if (extensionCount == 0)
@@ -559,6 +576,10 @@ static int check_physical_device_extensions_support(MyRenderContext *context, Vk
     vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, extensions);
 
     context->supportedFeatures.swapchainMaintenance1Support = VK_FALSE;
+    context->supportedFeatures.memoryBudgetSupport = VK_FALSE;
+    context->supportedFeatures.graphicsPipelineLibrarySupport = VK_FALSE;
+    context->supportedFeatures.shaderObjectSupport = VK_FALSE;
+    context->supportedFeatures.extendedDynamicState3Support = VK_FALSE;
     for (uint32_t i = 0; i < extensionCount; i++)
     {
         if (strcmp(extensions[i].extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0)
@@ -569,8 +590,31 @@ static int check_physical_device_extensions_support(MyRenderContext *context, Vk
         {
             context->supportedFeatures.swapchainMaintenance1Support = VK_TRUE;
         }
+        else if (strcmp(extensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+        {
+            context->supportedFeatures.memoryBudgetSupport = VK_TRUE;
+        }
+        else if (strcmp(extensions[i].extensionName, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) == 0)
+        {
+            graphicsPipelineLibrarySupport = VK_TRUE;
+        }
+        else if (strcmp(extensions[i].extensionName, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) == 0)
+        {
+            pipelineLibrarySupport = VK_TRUE;
+        }
+        else if (strcmp(extensions[i].extensionName, VK_EXT_SHADER_OBJECT_EXTENSION_NAME) == 0)
+        {
+            context->supportedFeatures.shaderObjectSupport = VK_TRUE;
+        }
+        else if (strcmp(extensions[i].extensionName, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) == 0)
+        {
+            context->supportedFeatures.extendedDynamicState3Support = VK_TRUE;
+        }
     }
 
+    // VK_EXT_graphics_pipeline_library depends on VK_KHR_pipeline_library, the features are checked later
+    context->supportedFeatures.graphicsPipelineLibrarySupport = graphicsPipelineLibrarySupport && pipelineLibrarySupport;
+
     free(extensions);
     return swapchainSupport;
 }
@@ -582,6 +626,11 @@ void choose_vulkan_physical_device(MyRenderContext *context, uint32_t flags)
     VkPhysicalDevice *devices = NULL;
     VkPhysicalDeviceProperties2 props = {0};
     VkPhysicalDeviceFeatures2 features = {0};
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures = {0};
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProperties = {0};
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures = {0};
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features = {0};
+    VkPhysicalDeviceShaderFloat16Int8Features float16Int8Features = {0};
 
 #ifdef VK_KHR_portability_subset
     VkPhysicalDevicePortabilitySubsetFeaturesKHR portabilityFeatures = {0};
@@ -597,6 +646,27 @@ void choose_vulkan_physical_device(MyRenderContext *context, uint32_t flags)
     }
 #endif
 
+    graphicsPipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    graphicsPipelineLibraryFeatures.pNext = features.pNext;
+    features.pNext = &graphicsPipelineLibraryFeatures;
+
+    graphicsPipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+    graphicsPipelineLibraryProperties.pNext = props.pNext;
+    props.pNext = &graphicsPipelineLibraryProperties;
+
+    shaderObjectFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+    shaderObjectFeatures.pNext = features.pNext;
+    features.pNext = &shaderObjectFeatures;
+
+    extendedDynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+    extendedDynamicState3Features.pNext = features.pNext;
+    features.pNext = &extendedDynamicState3Features;
+
+    // Core in Vulkan 1.2 but optional, selects the half precision shader variants
+    float16Int8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES;
+    float16Int8Features.pNext = features.pNext;
+    features.pNext = &float16Int8Features;
+
     props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
     features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
 
@@ -656,6 +726,18 @@ void choose_vulkan_physical_device(MyRenderContext *context, uint32_t flags)
         context->supportedFeatures.features = features.features;
         context->supportedFeatures.limits = props.properties.limits;
         context->supportedFeatures.deviceType = props.properties.deviceType;
+        // Libraries are only worth it if linking them is fast, the samples compile full pipelines otherwise
+        context->supportedFeatures.graphicsPipelineLibrarySupport = context->supportedFeatures.graphicsPipelineLibrarySupport &&
+            graphicsPipelineLibraryFeatures.graphicsPipelineLibrary && graphicsPipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+        context->supportedFeatures.shaderObjectSupport = context->supportedFeatures.shaderObjectSupport &&
+            shaderObjectFeatures.shaderObject;
+        // Only the states the pipelines make dynamic, see add_vulkan_pipeline_dynamic_states
+        context->supportedFeatures.extendedDynamicState3Support = context->supportedFeatures.extendedDynamicState3Support &&
+            extendedDynamicState3Features.extendedDynamicState3PolygonMode &&
+            extendedDynamicState3Features.extendedDynamicState3ColorBlendEnable &&
+            extendedDynamicState3Features.extendedDynamicState3ColorBlendEquation &&
+            extendedDynamicState3Features.extendedDynamicState3ColorWriteMask;
+        context->supportedFeatures.shaderVariantFeatures = float16Int8Features.shaderFloat16 ? SHADER_FEATURE_FLOAT16 : 0;
 
         if (flags & SAMPLE_USE_DISCRETE_GPU)
         {
@@ -698,11 +780,16 @@ void  create_vulkan_logical_device(MyRenderContext *context)
     VkPhysicalDeviceFeatures enabledFeatures = {0};
     float defaultQueuePriority[3] = {1.0f, 1.0f, 1.0f};
     uint32_t uniqueQueueFamilyCount = 0;
-    const char *enabledExtensions[4] = {0};
+    const char *enabledExtensions[16] = {0};
     VkPhysicalDevicePresentModeFifoLatestReadyFeaturesEXT presentModeFeatures = {0};
     VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenanceFeatures = {0};
     VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures = {0};
     VkPhysicalDeviceSynchronization2Features synchronization2Features = {0};
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {0};
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures = {0};
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures = {0};
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features = {0};
+    VkPhysicalDeviceShaderFloat16Int8Features float16Int8Features = {0};
     void *pNext = NULL;
     uint32_t *queueFamilyIndex = calloc(context->queueFamilyCount, sizeof(uint32_t));
     
@@ -763,6 +850,51 @@ void  create_vulkan_logical_device(MyRenderContext *context)
         pNext = &swapchainMaintenanceFeatures;
     }
 
+    if (context->supportedFeatures.memoryBudgetSupport)
+    {
+        enabledExtensions[deviceInfo.enabledExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+
+    if (context->supportedFeatures.graphicsPipelineLibrarySupport)
+    {
+        enabledExtensions[deviceInfo.enabledExtensionCount++] = VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME;
+        enabledExtensions[deviceInfo.enabledExtensionCount++] = VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+        graphicsPipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        graphicsPipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+        graphicsPipelineLibraryFeatures.pNext = pNext;
+        pNext = &graphicsPipelineLibraryFeatures;
+    }
+
+    if (context->supportedFeatures.shaderObjectSupport)
+    {
+        enabledExtensions[deviceInfo.enabledExtensionCount++] = VK_EXT_SHADER_OBJECT_EXTENSION_NAME;
+        shaderObjectFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+        shaderObjectFeatures.shaderObject = VK_TRUE;
+        shaderObjectFeatures.pNext = pNext;
+        pNext = &shaderObjectFeatures;
+    }
+
+    // Extended dynamic state 1 and 2 are core in Vulkan 1.3
+    if (context->supportedFeatures.extendedDynamicState3Support)
+    {
+        enabledExtensions[deviceInfo.enabledExtensionCount++] = VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME;
+        extendedDynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+        extendedDynamicState3Features.extendedDynamicState3PolygonMode = VK_TRUE;
+        extendedDynamicState3Features.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+        extendedDynamicState3Features.extendedDynamicState3ColorBlendEquation = VK_TRUE;
+        extendedDynamicState3Features.extendedDynamicState3ColorWriteMask = VK_TRUE;
+        extendedDynamicState3Features.pNext = pNext;
+        pNext = &extendedDynamicState3Features;
+    }
+
+    if (context->supportedFeatures.shaderVariantFeatures & SHADER_FEATURE_FLOAT16)
+    {
+        float16Int8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES;
+        float16Int8Features.shaderFloat16 = VK_TRUE;
+        float16Int8Features.pNext = pNext;
+        pNext = &float16Int8Features;
+    }
+
     dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
     dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
     dynamicRenderingFeatures.pNext = pNext;
@@ -771,11 +903,16 @@ void  create_vulkan_logical_device(MyRenderContext *context)
     synchronization2Features.synchronization2 = VK_TRUE;
     synchronization2Features.pNext = &dynamicRenderingFeatures;
 
-    deviceInfo.pNext = &synchronization2Features;
+    // Timeline semaphores are core since Vulkan 1.2, used to track transfer completion
+    timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+    timelineSemaphoreFeatures.pNext = &synchronization2Features;
+
+    deviceInfo.pNext = &timelineSemaphoreFeatures;
 
     printf("Activating the following device extensions:\n");
     print_extensions(enabledExtensions, deviceInfo.enabledExtensionCount);
-    CHECK_VK(vkCreateDevice(context->physicalDevice, &deviceInfo, NULL, &context->logicalDevice));
+    CHECK_VK(vkCreateDevice(context->physicalDevice, &deviceInfo, context->allocationCallbacks, &context->logicalDevice));
     // load device functions
     volkLoadDevice(context->logicalDevice);
 
@@ -791,6 +928,12 @@ void  create_vulkan_logical_device(MyRenderContext *context)
 
     SDL_assert(context->graphicsQueue.queue && context->presentQueue.queue && context->transferQueue.queue);
     free(queueFamilyIndex);
+
+    create_vulkan_memory_allocator(context);
+    create_vulkan_pipeline_cache(context);
+    create_vulkan_pipeline_builder(context);
+    create_vulkan_pipeline_table(context);
+    create_vulkan_shader_watch(context);
 }
 
 static void retrieve_vulkan_swapchain_info(MyRenderContext *context)
@@ -843,6 +986,8 @@ void create_vulkan_swapchain(MyRenderContext *context)
 {
     VkResult r;
     VkSwapchainKHR oldSwapchain = context->swapchainInfo.swapchain;
+    MySwapchainFramebuffer *oldFramebuffers = context->swapchainInfo.framebuffers;
+    uint32_t oldImageCount = context->swapchainInfo.imageCount;
     VkSwapchainCreateInfoKHR swapchainInfo = {0};
     VkImage *swapchainImages = NULL;
     VkSemaphoreCreateInfo semaphoreInfo = {0};
@@ -886,7 +1031,7 @@ void create_vulkan_swapchain(MyRenderContext *context)
     }
 
     // Create swapchain
-    CHECK_VK(vkCreateSwapchainKHR(context->logicalDevice, &swapchainInfo, NULL, &context->swapchainInfo.swapchain));
+    CHECK_VK(vkCreateSwapchainKHR(context->logicalDevice, &swapchainInfo, context->allocationCallbacks, &context->swapchainInfo.swapchain));
     // Retrieve swapchain images count, may not be the same as requested
     CHECK_VK(vkGetSwapchainImagesKHR(context->logicalDevice, context->swapchainInfo.swapchain, 
         &context->swapchainInfo.imageCount, NULL));
@@ -921,7 +1066,7 @@ void create_vulkan_swapchain(MyRenderContext *context)
         createImageInfo.subresourceRange.baseArrayLayer = 0;
         createImageInfo.subresourceRange.layerCount = 1;
 
-        CHECK_VK(vkCreateImageView(context->logicalDevice, &createImageInfo, NULL, &context->swapchainInfo.framebuffers[i].imageView));
+        CHECK_VK(vkCreateImageView(context->logicalDevice, &createImageInfo, context->allocationCallbacks, &context->swapchainInfo.framebuffers[i].imageView));
         context->swapchainInfo.framebuffers[i].image = swapchainImages[i];
 
         if (context->renderPass)
@@ -934,24 +1079,70 @@ void create_vulkan_swapchain(MyRenderContext *context)
             createFramebufferInfo.height = context->swapchainInfo.extent.height;
             createFramebufferInfo.layers = 1;
 
-            CHECK_VK(vkCreateFramebuffer(context->logicalDevice, &createFramebufferInfo, NULL, 
+            CHECK_VK(vkCreateFramebuffer(context->logicalDevice, &createFramebufferInfo, context->allocationCallbacks, 
                 &context->swapchainInfo.framebuffers[i].framebuffer));
         }
 
-        CHECK_VK(vkCreateSemaphore(context->logicalDevice, &semaphoreInfo, NULL, &context->swapchainInfo.framebuffers[i].presentationSemaphore));
-        CHECK_VK(vkCreateFence(context->logicalDevice, &fenceInfo, NULL, &context->swapchainInfo.framebuffers[i].presentationCompletedFence));
+        CHECK_VK(vkCreateSemaphore(context->logicalDevice, &semaphoreInfo, context->allocationCallbacks, &context->swapchainInfo.framebuffers[i].presentationSemaphore));
+        CHECK_VK(vkCreateFence(context->logicalDevice, &fenceInfo, context->allocationCallbacks, &context->swapchainInfo.framebuffers[i].presentationCompletedFence));
     }
 
     context->shaderUniforms.aspect = (float)context->swapchainInfo.extent.width / (float)context->swapchainInfo.extent.height;
-    // Destroy old swapchain, if exists
+    context->swapchainInfo.outOfDate = VK_FALSE;
+    context->swapchainInfo.firstAcquireFrame = UINT64_MAX;
+    // The old swapchain may still have frames rendering to or presenting its images, it is destroyed once they are done
     if (oldSwapchain != VK_NULL_HANDLE)
     {
-        vkDestroySwapchainKHR(context->logicalDevice, oldSwapchain, NULL);
+        defer_vulkan_swapchain_destroy(context, oldSwapchain, oldFramebuffers, oldImageCount);
     }
 
     free(swapchainImages);
 }
 
+// Returns VK_FALSE while the window is minimized, there is no extent to create the swapchain with
+static int recreate_vulkan_swapchain(MyRenderContext *context)
+{
+    int width = 0, height = 0;
+
+    SDL_Vulkan_GetDrawableSize(context->window, &width, &height);
+    if (width == 0 || height == 0)
+    {
+        return VK_FALSE;
+    }
+
+    create_vulkan_swapchain(context);
+    return VK_TRUE;
+}
+
+// VK_BEGINNER_FRAMES_IN_FLIGHT: 1 for the lowest latency, up to MAX_FRAMES_IN_FLIGHT for throughput, auto to tune it
+static void init_vulkan_frame_pacing(MyRenderContext *context)
+{
+    MyFramePacing *pacing = &context->framePacing;
+    const char *setting = getenv(FRAMES_IN_FLIGHT_ENV);
+    int count;
+
+    memset(pacing, 0, sizeof(MyFramePacing));
+    pacing->frameInFlightCount = DEFAULT_FRAMES_IN_FLIGHT;
+
+    if (setting && strcmp(setting, "auto") == 0)
+    {
+        pacing->autoTune = VK_TRUE;
+    }
+    else if (setting && setting[0])
+    {
+        if ((count = atoi(setting)) >= 1 && count <= MAX_FRAMES_IN_FLIGHT)
+        {
+            pacing->frameInFlightCount = (uint32_t)count;
+        }
+        else
+        {
+            fprintf(stderr, "Ignoring %s=%s, expected 1 to %u or auto\n", FRAMES_IN_FLIGHT_ENV, setting, MAX_FRAMES_IN_FLIGHT);
+        }
+    }
+
+    printf("Frames in flight: %u%s\n", pacing->frameInFlightCount, pacing->autoTune ? ", auto-tuned" : "");
+}
+
 void create_vulkan_command_buffers(MyRenderContext *context)
 {
     VkResult r;
@@ -959,16 +1150,16 @@ void create_vulkan_command_buffers(MyRenderContext *context)
     VkCommandBufferAllocateInfo commandBufferInfo = {0};
     VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
     VkSemaphoreCreateInfo semaphoreInfo = {0};
-    VkFenceCreateInfo fenceInfo = {0};
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo = {0};
 
     commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     commandPoolInfo.queueFamilyIndex = context->graphicsQueue.familyIndex;
 
-    CHECK_VK(vkCreateCommandPool(context->logicalDevice, &commandPoolInfo, NULL, &context->commandPool));
+    CHECK_VK(vkCreateCommandPool(context->logicalDevice, &commandPoolInfo, context->allocationCallbacks, &context->commandPool));
 
     commandPoolInfo.queueFamilyIndex = context->transferQueue.familyIndex;
-    CHECK_VK(vkCreateCommandPool(context->logicalDevice, &commandPoolInfo, NULL, &context->transferCommandPool));
+    CHECK_VK(vkCreateCommandPool(context->logicalDevice, &commandPoolInfo, context->allocationCallbacks, &context->transferCommandPool));
 
     commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     commandBufferInfo.commandPool = context->commandPool; // one shared command pool for all frames in flight
@@ -976,98 +1167,272 @@ void create_vulkan_command_buffers(MyRenderContext *context)
     commandBufferInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT; // command buffer for each frame in flight
 
     CHECK_VK(vkAllocateCommandBuffers(context->logicalDevice, &commandBufferInfo, commandBuffers));
+    init_vulkan_frame_pacing(context);
 
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
         context->framesInFlight[i].commandBuffer = commandBuffers[i];
+        context->framesInFlight[i].submittedFrameCount = 0;
 
-        CHECK_VK(vkCreateSemaphore(context->logicalDevice, &semaphoreInfo, NULL, &context->framesInFlight[i].imageAvailableSemaphore));
-        CHECK_VK(vkCreateFence(context->logicalDevice, &fenceInfo, NULL, &context->framesInFlight[i].submitCompletedFence));
-    }
-}
-
-static void destroy_vulkan_swapchain_framebuffers(MyRenderContext *context)
-{
-    VkFence *fences = malloc(sizeof(VkFence) * context->swapchainInfo.imageCount);
-    for (uint32_t i = 0; i < context->swapchainInfo.imageCount; i++)
-    {
-        fences[i] = context->swapchainInfo.framebuffers[i].presentationCompletedFence;
+        CHECK_VK(vkCreateSemaphore(context->logicalDevice, &semaphoreInfo, context->allocationCallbacks, &context->framesInFlight[i].imageAvailableSemaphore));
     }
 
-    // wait for all images in swapchain have been presented before destroying swapchain
-    vkWaitForFences(context->logicalDevice, context->swapchainInfo.imageCount, fences, VK_TRUE, UINT64_MAX);
-    free(fences);
-
-    for (uint32_t i = 0; i < context->swapchainInfo.imageCount; i++)
-    {
-        vkDestroyFramebuffer(context->logicalDevice, context->swapchainInfo.framebuffers[i].framebuffer, NULL);
-        vkDestroyImageView(context->logicalDevice, context->swapchainInfo.framebuffers[i].imageView, NULL);
-        vkDestroySemaphore(context->logicalDevice, context->swapchainInfo.framebuffers[i].presentationSemaphore, NULL);
-        vkDestroyFence(context->logicalDevice, context->swapchainInfo.framebuffers[i].presentationCompletedFence, NULL);
-    }
-    
-    free(context->swapchainInfo.framebuffers);
-    context->swapchainInfo.imageCount = 0;
-    context->swapchainInfo.framebuffers = NULL;
+    // One timeline per queue: every frame submit signals frameNumber + 1 on the graphics queue, 
+    // every transfer submit signals the next value on the transfer queue
+    semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeInfo.initialValue = 0;
+    semaphoreInfo.pNext = &semaphoreTypeInfo;
+
+    CHECK_VK(vkCreateSemaphore(context->logicalDevice, &semaphoreInfo, context->allocationCallbacks, &context->frameTimeline));
+    context->frameStats.completedFrameCount = 0;
+    CHECK_VK(vkCreateSemaphore(context->logicalDevice, &semaphoreInfo, context->allocationCallbacks, &context->transferTimeline));
+    context->transferTimelineValue = 0;
+
+    create_vulkan_staging_ring(context);
+    create_vulkan_transient_buffer(context);
+    create_vulkan_record_workers(context);
 }
 
+
 void destroy_context(MyRenderContext *context)
 {
     // wait for the device to finish all executing commands
     vkDeviceWaitIdle(context->logicalDevice);
+    destroy_vulkan_shader_watch(context);
+    destroy_vulkan_shader_objects(context, &context->shaderObjects);
+    // waits for the pipelines still compiling
+    print_vulkan_pipeline_table_stats(context);
+    destroy_vulkan_pipeline_table(context);
+    destroy_vulkan_pipeline_builder(context);
+
+    destroy_vulkan_record_workers(context);
 
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
-        vkDestroySemaphore(context->logicalDevice, context->framesInFlight[i].imageAvailableSemaphore, NULL);
-        vkDestroyFence(context->logicalDevice, context->framesInFlight[i].submitCompletedFence, NULL);
+        vkDestroySemaphore(context->logicalDevice, context->framesInFlight[i].imageAvailableSemaphore, context->allocationCallbacks);
     }
 
-    destroy_vulkan_swapchain_framebuffers(context);
+    // Every frame finished, only the presents may still be using the swapchains
+    defer_vulkan_swapchain_destroy(context, context->swapchainInfo.swapchain, context->swapchainInfo.framebuffers,
+        context->swapchainInfo.imageCount);
+    flush_vulkan_destroy_queue(context);
     destroy_auxiliary(context);
-
-    vkDestroyCommandPool(context->logicalDevice, context->commandPool, NULL);
-    vkDestroyCommandPool(context->logicalDevice, context->transferCommandPool, NULL);
-    vkDestroyPipeline(context->logicalDevice, context->graphicsPipeline, NULL);
-    vkDestroyPipelineLayout(context->logicalDevice, context->graphicsPipelineLayout, NULL);
-    vkDestroyRenderPass(context->logicalDevice, context->renderPass, NULL);
-    vkDestroySwapchainKHR(context->logicalDevice, context->swapchainInfo.swapchain, NULL);
-    vkDestroyDevice(context->logicalDevice, NULL);
+    destroy_vulkan_transient_buffer(context);
+    destroy_vulkan_staging_ring(context);
+    destroy_vulkan_memory_allocator(context);
+
+    vkDestroySemaphore(context->logicalDevice, context->frameTimeline, context->allocationCallbacks);
+    vkDestroySemaphore(context->logicalDevice, context->transferTimeline, context->allocationCallbacks);
+
+    vkDestroyCommandPool(context->logicalDevice, context->commandPool, context->allocationCallbacks);
+    vkDestroyCommandPool(context->logicalDevice, context->transferCommandPool, context->allocationCallbacks);
+    destroy_vulkan_pipeline_cache(context);
+    vkDestroyRenderPass(context->logicalDevice, context->renderPass, context->allocationCallbacks);
+    vkDestroyDevice(context->logicalDevice, context->allocationCallbacks);
+    // Surface is created by SDL without allocation callbacks
     vkDestroySurfaceKHR(context->instance, context->surface, NULL);
     
     if (context->debugUtilsMessenger) 
     {
-        vkDestroyDebugUtilsMessengerEXT(context->instance, context->debugUtilsMessenger, NULL);
+        vkDestroyDebugUtilsMessengerEXT(context->instance, context->debugUtilsMessenger, context->allocationCallbacks);
     }
 
-    vkDestroyInstance(context->instance, NULL);
+    vkDestroyInstance(context->instance, context->allocationCallbacks);
+    print_vulkan_host_allocator_stats(context);
+    destroy_vulkan_host_allocator(context);
     SDL_DestroyWindow(context->window);
     SDL_QuitSubSystem(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
     SDL_Quit();
 }
 
+int is_vulkan_frame_completed(MyRenderContext *context, uint64_t frameNumber)
+{
+    VkResult r;
+    uint64_t value;
+
+    if (frameNumber < context->frameStats.completedFrameCount)
+    {
+        return VK_TRUE;
+    }
+
+    CHECK_VK(vkGetSemaphoreCounterValue(context->logicalDevice, context->frameTimeline, &value));
+    context->frameStats.completedFrameCount = MAX(context->frameStats.completedFrameCount, value);
+
+    return frameNumber < context->frameStats.completedFrameCount;
+}
+
+void wait_vulkan_frame_timeline(MyRenderContext *context, uint64_t value)
+{
+    VkResult r;
+    VkSemaphoreWaitInfo waitInfo = {0};
+
+    // Skipped frames never signal their value, waiting for the last submit covers them
+    value = MIN(value, context->frameStats.submittedFrameCount);
+    if (value <= context->frameStats.completedFrameCount)
+    {
+        return;
+    }
+
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &context->frameTimeline;
+    waitInfo.pValues = &value;
+
+    CHECK_VK(vkWaitSemaphores(context->logicalDevice, &waitInfo, UINT64_MAX));
+    context->frameStats.completedFrameCount = value;
+}
+
+// Waits for the last frame submitted with this slot, the timeline value also covers all the frames submitted before it.
+// With auto-tune the wait gives the GPU time of that frame: from its submit, or from the end of the previous
+// frame if the GPU was still busy with it, to the timeline signal.
+static void wait_vulkan_frame_in_flight(MyRenderContext *context, MyFrameInFlight *frameInFlight)
+{
+    MyFramePacing *pacing = &context->framePacing;
+    uint64_t waitTick = SDL_GetPerformanceCounter();
+    uint64_t startTick, completionTick;
+    uint8_t finished;
+
+    if (frameInFlight->submittedFrameCount == 0)
+    {
+        return;
+    }
+
+    finished = is_vulkan_frame_completed(context, frameInFlight->submittedFrameCount - 1);
+    if (!finished)
+    {
+        wait_vulkan_frame_timeline(context, frameInFlight->submittedFrameCount);
+    }
+
+    if (!pacing->autoTune)
+    {
+        return;
+    }
+
+    // A frame finished before the wait finished some time before it, the estimate is an upper bound then
+    completionTick = finished ? waitTick : SDL_GetPerformanceCounter();
+    startTick = frameInFlight->submitTick > pacing->lastCompletionTick ? frameInFlight->submitTick : pacing->lastCompletionTick;
+    if (completionTick > startTick)
+    {
+        pacing->gpuTicks += completionTick - startTick;
+        pacing->gpuSampleCount++;
+    }
+
+    pacing->lastCompletionTick = completionTick;
+}
+
+static int compare_ticks(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return left < right ? -1 : left > right;
+}
+
+// Smallest count keeping the GPU busy: while it executes the other frames in flight, the CPU records the next one,
+// so (count - 1) * GPU time must cover the record time, the 90th percentile to absorb spikes. If recording takes longer
+// than executing on average, no depth keeps the GPU busy and 2 frames already overlap recording with execution.
+static void tune_vulkan_frames_in_flight(MyRenderContext *context)
+{
+    MyFramePacing *pacing = &context->framePacing;
+    uint64_t cpuTicks[FRAME_PACING_SAMPLES];
+    uint32_t sampleCount = pacing->cpuSampleCount < FRAME_PACING_SAMPLES ? pacing->cpuSampleCount : FRAME_PACING_SAMPLES;
+    uint64_t cpuTotal = 0, cpuPeak, gpuAverage;
+    uint32_t count;
+
+    if (sampleCount == 0 || pacing->gpuSampleCount == 0)
+    {
+        return;
+    }
+
+    memcpy(cpuTicks, pacing->cpuTicks, sizeof(uint64_t) * sampleCount);
+    qsort(cpuTicks, sampleCount, sizeof(uint64_t), compare_ticks);
+    for (uint32_t i = 0; i < sampleCount; i++)
+    {
+        cpuTotal += cpuTicks[i];
+    }
+
+    cpuPeak = cpuTicks[sampleCount * 9 / 10];
+    gpuAverage = pacing->gpuTicks / pacing->gpuSampleCount;
+
+    if (gpuAverage == 0 || cpuTotal / sampleCount >= gpuAverage)
+    {
+        count = 2;
+    }
+    else
+    {
+        count = 1 + (uint32_t)((cpuPeak + gpuAverage - 1) / gpuAverage);
+        count = count < MAX_FRAMES_IN_FLIGHT ? count : MAX_FRAMES_IN_FLIGHT;
+    }
+
+    if (count != pacing->frameInFlightCount)
+    {
+        printf("Frames in flight: %u -> %u, record %.3f ms (90th percentile %.3f ms), GPU %.3f ms\n",
+            pacing->frameInFlightCount, count, 1000.0 * cpuTotal / sampleCount / context->frameStats.timerFreq,
+            1000.0 * cpuPeak / context->frameStats.timerFreq, 1000.0 * gpuAverage / context->frameStats.timerFreq);
+        pacing->frameInFlightCount = count;
+    }
+
+    pacing->cpuSampleCount = 0;
+    pacing->gpuTicks = 0;
+    pacing->gpuSampleCount = 0;
+}
+
 void draw_frame(MyRenderContext *context) 
 {
     VkResult r;
     void *pNext = NULL;
     MyFrameInFlight *currentFrameInFlight = context->framesInFlight + context->frameStats.frameInFlightIndex;
     VkSubmitInfo2 submitInfo = {0};
-    VkSemaphoreSubmitInfo waitSemaphoreInfo = {0};
-    VkSemaphoreSubmitInfo signalSemaphoreInfo = {0};
+    VkSemaphoreSubmitInfo waitSemaphoreInfo[2] = {0};
+    VkSemaphoreSubmitInfo signalSemaphoreInfo[2] = {0};
     VkCommandBufferSubmitInfo commandBufferInfo = {0};
     VkPresentInfoKHR presentInfo = {0};
     VkSwapchainPresentFenceInfoEXT presentFenceInfo = {0};
     VkSwapchainPresentModeInfoEXT presentModeInfo = {0};
+    uint64_t recordTick;
 
     // Wait until all previous render commands owned by the current "frame in flight" have completed 
-    vkWaitForFences(context->logicalDevice, 1, &currentFrameInFlight->submitCompletedFence, VK_TRUE, UINT64_MAX);
-    vkResetFences(context->logicalDevice, 1, &currentFrameInFlight->submitCompletedFence);
+    wait_vulkan_frame_in_flight(context, currentFrameInFlight);
+    // GPU is done with the transient data of this frame in flight
+    reset_vulkan_transient_buffer(context, context->frameStats.frameInFlightIndex);
+    reset_vulkan_record_pools(context, context->frameStats.frameInFlightIndex);
+    // Destroy the objects released by the frames that finished
+    update_vulkan_destroy_queue(context);
+    // Frame boundary, swap in the pipelines rebuilt after shader changes
+    update_vulkan_shader_watch(context);
+
+    // Recreated without waiting for the frames in flight, they keep rendering to the retired swapchain
+    if (context->swapchainInfo.outOfDate && !recreate_vulkan_swapchain(context))
+    {
+        return;
+    }
 
-    CHECK_VK(vkAcquireNextImageKHR(context->logicalDevice, context->swapchainInfo.swapchain, UINT64_MAX, 
-        currentFrameInFlight->imageAvailableSemaphore, VK_NULL_HANDLE, &currentFrameInFlight->imageIndex));
+    r = vkAcquireNextImageKHR(context->logicalDevice, context->swapchainInfo.swapchain, UINT64_MAX, 
+        currentFrameInFlight->imageAvailableSemaphore, VK_NULL_HANDLE, &currentFrameInFlight->imageIndex);
+    if (r == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        // No image was acquired and the semaphore stays unsignaled, the frame is skipped
+        context->swapchainInfo.outOfDate = VK_TRUE;
+        return;
+    }
+    else if (r == VK_SUBOPTIMAL_KHR)
+    {
+        // The image is acquired and still presentable, the swapchain is recreated at the next frame
+        context->swapchainInfo.outOfDate = VK_TRUE;
+    }
+    else
+    {
+        CHECK_VK(r);
+    }
+
+    // Without present fences, the retired swapchains wait for a frame using an image of this one to complete
+    if (context->swapchainInfo.firstAcquireFrame == UINT64_MAX)
+    {
+        context->swapchainInfo.firstAcquireFrame = context->frameStats.frameNumber;
+    }
 
     // Wait and reset presentation fence if supported
     if (context->supportedFeatures.swapchainMaintenance1Support)
@@ -1088,29 +1453,59 @@ void draw_frame(MyRenderContext *context)
     }
     // Reset current command buffer 
     vkResetCommandBuffer(currentFrameInFlight->commandBuffer, 0);
+    // Release completed uploads, buffers uploaded before that need no transfer wait anymore
+    poll_vulkan_transfers(context);
+    currentFrameInFlight->transferWaitValue = 0;
+    currentFrameInFlight->transferWaitStages = VK_PIPELINE_STAGE_2_NONE;
 
     // Record render commands
+    recordTick = SDL_GetPerformanceCounter();
     record_render_commands(context, currentFrameInFlight);
 
-    waitSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-    waitSemaphoreInfo.semaphore = currentFrameInFlight->imageAvailableSemaphore;
-    waitSemaphoreInfo.stageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT; // Do not execute any submited commands until the swapchain image becomes available
-    signalSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-    signalSemaphoreInfo.semaphore = context->swapchainInfo.framebuffers[currentFrameInFlight->imageIndex].presentationSemaphore;
-    signalSemaphoreInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT; // Signal then all submited commands have been processed
+    waitSemaphoreInfo[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    waitSemaphoreInfo[0].semaphore = currentFrameInFlight->imageAvailableSemaphore;
+    waitSemaphoreInfo[0].stageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT; // Do not execute any submited commands until the swapchain image becomes available
+    submitInfo.waitSemaphoreInfoCount = 1;
+
+    // Wait for the uploads of the buffers used by the frame, only at the stages reading them
+    if (currentFrameInFlight->transferWaitValue > 0)
+    {
+        waitSemaphoreInfo[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        waitSemaphoreInfo[1].semaphore = context->transferTimeline;
+        waitSemaphoreInfo[1].value = currentFrameInFlight->transferWaitValue;
+        waitSemaphoreInfo[1].stageMask = currentFrameInFlight->transferWaitStages;
+        submitInfo.waitSemaphoreInfoCount++;
+    }
+
+    signalSemaphoreInfo[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signalSemaphoreInfo[0].semaphore = context->swapchainInfo.framebuffers[currentFrameInFlight->imageIndex].presentationSemaphore;
+    signalSemaphoreInfo[0].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT; // Signal then all submited commands have been processed
+
+    // The frame timeline replaces a fence per frame in flight, it needs no reset and tells any frame's completion
+    signalSemaphoreInfo[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signalSemaphoreInfo[1].semaphore = context->frameTimeline;
+    signalSemaphoreInfo[1].value = context->frameStats.frameNumber + 1;
+    signalSemaphoreInfo[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
 
     commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
     commandBufferInfo.commandBuffer = currentFrameInFlight->commandBuffer;
 
     // Submit render commands
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
-    submitInfo.waitSemaphoreInfoCount = 1;
-    submitInfo.pWaitSemaphoreInfos = &waitSemaphoreInfo;
-    submitInfo.signalSemaphoreInfoCount = 1;
-    submitInfo.pSignalSemaphoreInfos = &signalSemaphoreInfo;
+    submitInfo.pWaitSemaphoreInfos = waitSemaphoreInfo;
+    submitInfo.signalSemaphoreInfoCount = 2;
+    submitInfo.pSignalSemaphoreInfos = signalSemaphoreInfo;
     submitInfo.commandBufferInfoCount = 1;
     submitInfo.pCommandBufferInfos = &commandBufferInfo;
-    CHECK_VK(vkQueueSubmit2(context->graphicsQueue.queue, 1, &submitInfo, currentFrameInFlight->submitCompletedFence));
+    CHECK_VK(vkQueueSubmit2(context->graphicsQueue.queue, 1, &submitInfo, VK_NULL_HANDLE));
+    currentFrameInFlight->submitTick = SDL_GetPerformanceCounter();
+    currentFrameInFlight->submittedFrameCount = context->frameStats.frameNumber + 1;
+    context->frameStats.submittedFrameCount = currentFrameInFlight->submittedFrameCount;
+    if (context->framePacing.autoTune)
+    {
+        context->framePacing.cpuTicks[context->framePacing.cpuSampleCount++ % FRAME_PACING_SAMPLES] =
+            currentFrameInFlight->submitTick - recordTick;
+    }
 
     // Present image to the screen
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1120,7 +1515,15 @@ void draw_frame(MyRenderContext *context)
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &context->swapchainInfo.swapchain;
     presentInfo.pImageIndices = &currentFrameInFlight->imageIndex;
-    CHECK_VK(vkQueuePresentKHR(context->presentQueue.queue, &presentInfo));
+    r = vkQueuePresentKHR(context->presentQueue.queue, &presentInfo);
+    if (r == VK_ERROR_OUT_OF_DATE_KHR || r == VK_SUBOPTIMAL_KHR)
+    {
+        context->swapchainInfo.outOfDate = VK_TRUE;
+    }
+    else
+    {
+        CHECK_VK(r);
+    }
 }
 
 void update_frame_stats(MyRenderContext *context)
@@ -1138,8 +1541,6 @@ void update_frame_stats(MyRenderContext *context)
 
     context->frameStats.frameNumber++;
     context->frameStats.framesPerSecond++;
-    // switch to next frame in flight
-    context->frameStats.frameInFlightIndex = context->frameStats.frameNumber % MAX_FRAMES_IN_FLIGHT;
 
     if (currentTimerTick - context->frameStats.lastTimerTick >= context->frameStats.timerFreq)
     {
@@ -1147,14 +1548,19 @@ void update_frame_stats(MyRenderContext *context)
         printf("Total frames: %lu, FPS: %lu\n", (unsigned long)context->frameStats.frameNumber, 
             (unsigned long)context->frameStats.framesPerSecond);
         context->frameStats.framesPerSecond = 0;
+
+        if (context->framePacing.autoTune)
+        {
+            tune_vulkan_frames_in_flight(context);
+        }
     }
+
+    // switch to next frame in flight, the slot waited next also covers a count changed by the tuning
+    context->frameStats.frameInFlightIndex = context->frameStats.frameNumber % context->framePacing.frameInFlightCount;
 }
 
 void resize_sdl2_vulkan_window(MyRenderContext *context)
 {
-    vkDeviceWaitIdle(context->logicalDevice);
-    destroy_vulkan_swapchain_framebuffers(context);
-    
     context->isFullscreen = !context->isFullscreen;
     if (context->isFullscreen)
     {
@@ -1166,7 +1572,8 @@ void resize_sdl2_vulkan_window(MyRenderContext *context)
         SDL_SetWindowSize(context->window, INITIAL_WINDOW_WIDTH, INITIAL_WINDOW_HEIGHT);
     }
 
-    create_vulkan_swapchain(context);
+    // The next draw_frame recreates the swapchain with the new size
+    context->swapchainInfo.outOfDate = VK_TRUE;
     SDL_ShowWindow(context->window);
 }
 
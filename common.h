@@ -17,15 +17,83 @@
 #   define CLAMP(value, min, max) MIN(MAX(value, min), max)
 #endif
 
+#ifndef ALIGN_UP
+#   define ALIGN_UP(value, alignment) ((((value) + (alignment) - 1) / (alignment)) * (alignment))
+#endif
+
 #define SAMPLE_FULLSCREEN           0x00000001
 #define SAMPLE_VALIDATION_LAYERS    0x00000002
 #define SAMPLE_USE_DISCRETE_GPU     0x00000004
 #define SAMPLE_ENABLE_VSYNC         0x00000008
+#define SAMPLE_HOST_MEMORY_POOL     0x00000010
 
 #define INITIAL_WINDOW_WIDTH        1024
 #define INITIAL_WINDOW_HEIGHT       768
 
-#define MAX_FRAMES_IN_FLIGHT        2
+// Frames in flight, the count is chosen at runtime with VK_BEGINNER_FRAMES_IN_FLIGHT=1..4 or auto,
+// the resources of all MAX_FRAMES_IN_FLIGHT slots are created so the count can change at any frame
+#define MAX_FRAMES_IN_FLIGHT        4
+#define DEFAULT_FRAMES_IN_FLIGHT    2
+// Auto-tune window, CPU record times of the last frames
+#define FRAME_PACING_SAMPLES        128
+
+// Preferred size of the device memory blocks the buffers are sub-allocated from
+#define MEMORY_BLOCK_SIZE           (64ull * 1024 * 1024)
+// Heap budget in percents of the heap size if VK_EXT_memory_budget is not supported
+#define MEMORY_DEFAULT_BUDGET       80
+// Resources of this size and larger get a dedicated VkDeviceMemory
+#define DEDICATED_ALLOCATION_SIZE   (MEMORY_BLOCK_SIZE / 2)
+#define DEDICATED_POLICY_HEURISTIC  0 // driver preference or size threshold
+#define DEDICATED_POLICY_REQUIRED   1 // only if the driver requires it, everything else is sub-allocated
+
+// Persistently mapped staging memory reused by all uploads
+#define STAGING_RING_SIZE           (16ull * 1024 * 1024)
+#define STAGING_RING_MAX_REGIONS    256
+#define MAX_PENDING_TRANSFERS       32
+
+// Upload policies, direct uploads write into host visible device local memory (ReBAR or unified memory) without a copy
+#define UPLOAD_POLICY_AUTO          0 // direct upload for small buffers if the heap has room, staging otherwise
+#define UPLOAD_POLICY_ALWAYS_STAGE  1
+#define UPLOAD_POLICY_PREFER_DIRECT 2
+#define DIRECT_UPLOAD_MAX_SIZE      (1ull * 1024 * 1024)
+// Host allocator, small Vulkan host allocations are served from size class pools
+#define HOST_MEMORY_SCOPE_COUNT     (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+#define HOST_MEMORY_POOL_CLASSES    6 // 16, 32, 64, 128, 256, 512 bytes
+#define HOST_MEMORY_POOL_CHUNK_SIZE (64 * 1024)
+
+// Transient memory for the per frame data, each frame in flight owns a slice of this size
+#define TRANSIENT_FRAME_SIZE        (4ull * 1024 * 1024)
+
+// Pipelines are compiled by worker threads, one less than the CPU count up to this limit
+#define PIPELINE_BUILDER_MAX_WORKERS 8
+// The job array starts with this many slots and doubles when every slot holds a job not collected yet
+#define PIPELINE_BUILDER_INITIAL_JOBS 64
+// A handle is the slot index in the low bits and the slot generation in the high bits
+#define PIPELINE_HANDLE_INDEX_BITS  16
+#define PIPELINE_HANDLE_INDEX_MASK  ((1u << PIPELINE_HANDLE_INDEX_BITS) - 1)
+#define PIPELINE_JOB_FREE           0
+#define PIPELINE_JOB_QUEUED         1
+#define PIPELINE_JOB_RUNNING        2
+#define PIPELINE_JOB_DONE           3
+
+// Parallel command recording, the draws are split in jobs recorded into secondary command buffers by the record workers
+// and the main thread. The worker count is one less than the CPU count up to this limit.
+#define RECORD_MAX_WORKERS          8
+#define RECORD_MIN_DRAWS_PER_JOB    64
+
+// Pipeline state description limits, the description is hashed as raw bytes
+#define PIPELINE_MAX_SHADER_STAGES  3
+#define PIPELINE_SHADER_NAME_SIZE   32
+#define PIPELINE_MAX_VERTEX_BINDINGS 4
+#define PIPELINE_MAX_VERTEX_ATTRIBUTES 8
+#define PIPELINE_MAX_COLOR_ATTACHMENTS 4
+#define PIPELINE_MAX_DYNAMIC_STATES 16
+#define PIPELINE_MAX_PUSH_CONSTANT_RANGES 2
+#define PIPELINE_MAX_DESCRIPTOR_SETS 4
+#define PIPELINE_MAX_SET_BINDINGS 8
+#define PIPELINE_TABLE_INITIAL_SIZE 64
+// VK_EXT_graphics_pipeline_library parts: vertex input, pre-rasterization shaders, fragment shader, fragment output
+#define PIPELINE_LIBRARY_PART_COUNT 4
 
 #pragma pack(push, 4)
 typedef struct MyShaderUniforms
@@ -35,13 +103,334 @@ typedef struct MyShaderUniforms
 } MyShaderUniforms;
 #pragma pack(pop)
 
+typedef struct MyMemoryRange
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} MyMemoryRange;
+
+typedef struct MyMemoryBlock
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    uint32_t allocationCount;
+    void *mapped; // host visible blocks are mapped once for their whole lifetime
+    MyMemoryRange *freeRanges; // sorted by offset, adjacent ranges are always merged
+    uint32_t freeRangeCount;
+    uint32_t freeRangeCapacity;
+    uint8_t dedicated; // owned by a single resource, never shared
+    struct MyMemoryBlock *next;
+} MyMemoryBlock;
+
+typedef struct MyMemoryAllocation
+{
+    MyMemoryBlock *block;
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void *mapped;
+} MyMemoryAllocation;
+
+typedef struct MyMemoryHeapStats
+{
+    VkMemoryHeapFlags flags;
+    VkDeviceSize size;
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    VkDeviceSize blockBytes;
+    VkDeviceSize usedBytes;
+} MyMemoryHeapStats;
+
+typedef struct MyMemoryAllocator
+{
+    MyMemoryBlock *blocks[VK_MAX_MEMORY_TYPES];
+    VkDeviceSize bufferImageGranularity;
+    VkDeviceSize heapBlockBytes[VK_MAX_MEMORY_HEAPS]; // bytes of memory blocks allocated from each heap
+    VkDeviceSize heapUsedBytes[VK_MAX_MEMORY_HEAPS]; // bytes of live sub-allocations
+    VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS]; // memory the process can use without degrading, VK_EXT_memory_budget
+    VkDeviceSize heapBudgetUsage[VK_MAX_MEMORY_HEAPS]; // memory used by the process, by all the allocators
+    uint32_t directUploadHeapIndex; // largest heap with host visible device local memory, UINT32_MAX if none
+    uint32_t dedicatedPolicy;
+    uint32_t blockCount;
+    uint32_t dedicatedCount;
+    uint32_t allocationCount;
+} MyMemoryAllocator;
+
 typedef struct VBuffer
 {
     VkBuffer buffer;
-    VkDeviceMemory memory;
     VkDeviceSize size;
+    MyMemoryAllocation allocation;
+    uint64_t uploadTimelineValue; // transfer timeline value to wait for before the first use, 0 if ready
+    uint8_t acquirePending; // queue family ownership must be acquired by the graphics queue
 } VBuffer;
 
+typedef struct MyHostMemoryStats
+{
+    size_t currentBytes;
+    size_t peakBytes;
+    size_t internalBytes; // driver internal allocations reported by notifications
+    uint64_t allocationCount; // total allocations made, reallocations included
+    uint64_t liveCount;
+} MyHostMemoryStats;
+
+typedef struct MyHostAllocator
+{
+    VkAllocationCallbacks callbacks;
+    SDL_SpinLock lock; // drivers may allocate from any thread
+    uint8_t usePool;
+    MyHostMemoryStats scopes[HOST_MEMORY_SCOPE_COUNT];
+    MyHostMemoryStats total;
+    void *freeSlots[HOST_MEMORY_POOL_CLASSES];
+    void *chunks; // pool chunks linked through their first bytes
+    uint8_t *chunkCursor;
+    size_t chunkRemaining;
+    size_t poolBytes;
+} MyHostAllocator;
+
+typedef struct MyStagingRegion
+{
+    uint64_t end; // ring position right after the region
+    uint64_t timelineValue; // the region may be reused once the transfer timeline reaches this value
+} MyStagingRegion;
+
+typedef struct MyStagingRing
+{
+    VBuffer buffer;
+    uint64_t head; // total bytes handed out, position in the buffer is head % size
+    uint64_t tail; // total bytes reclaimed
+    MyStagingRegion regions[STAGING_RING_MAX_REGIONS];
+    uint32_t firstRegion;
+    uint32_t regionCount;
+} MyStagingRing;
+
+typedef struct MyTransientBuffer
+{
+    VBuffer buffer; // one persistently mapped buffer shared by all frames in flight
+    VkDeviceSize alignment;
+    VkDeviceSize heads[MAX_FRAMES_IN_FLIGHT]; // bump offset inside the slice of each frame in flight
+} MyTransientBuffer;
+
+typedef struct MyTransientAllocation
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void *mapped;
+} MyTransientAllocation;
+
+typedef struct MyUploadBatch
+{
+    VkCommandBuffer commandBuffer;
+    uint32_t copyCount;
+    // temporary staging buffers of the uploads which do not fit the staging ring
+    VBuffer *stagingBuffers;
+    uint32_t stagingBufferCount;
+    // ownership release barriers recorded at flush when transfer and graphics queue families differ
+    VkBufferMemoryBarrier2 *releaseBarriers;
+    uint32_t releaseBarrierCount;
+} MyUploadBatch;
+
+typedef struct MyPendingTransfer
+{
+    MyUploadBatch batch;
+    uint64_t timelineValue; // batch resources are released once the transfer timeline reaches this value
+} MyPendingTransfer;
+
+typedef struct MyRenderContext MyRenderContext;
+// Runs on a worker thread, shader modules and pipeline layouts are created there as well
+typedef VkPipeline (*MyPipelineBuildFunc)(MyRenderContext *context, void *userData);
+
+typedef struct MyPipelineJob
+{
+    MyPipelineBuildFunc build;
+    void *userData;
+    VkPipeline pipeline;
+    uint32_t state;
+    uint32_t generation; // incremented when the job is collected, stale handles do not match
+} MyPipelineJob;
+
+typedef struct MyPipelineBuilder
+{
+    SDL_Thread *workers[PIPELINE_BUILDER_MAX_WORKERS];
+    uint32_t workerCount;
+    SDL_mutex *lock;
+    SDL_cond *jobQueued;
+    SDL_cond *jobDone;
+    MyPipelineJob *jobs;
+    uint32_t jobCapacity;
+    // free slots, used as a stack
+    uint32_t *freeSlots;
+    uint32_t freeCount;
+    // slots of the queued jobs in submit order, a ring of jobCapacity entries
+    uint32_t *queue;
+    uint32_t queueHead;
+    uint32_t queueCount;
+    uint8_t quit;
+} MyPipelineBuilder;
+
+// Runs on a record worker or on the main thread, records the draws [firstDraw, firstDraw + drawCount) into a secondary
+// command buffer continuing the render pass or dynamic rendering of the frame. Secondaries inherit no bound state.
+typedef void (*MyRecordFunc)(MyRenderContext *context, VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount,
+    void *userData);
+
+typedef struct MyRecordThread
+{
+    MyRenderContext *context;
+    // One pool per frame in flight, reset when the frame in flight is reused, so no pool is shared between threads
+    VkCommandPool commandPools[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer *commandBuffers[MAX_FRAMES_IN_FLIGHT]; // secondaries allocated so far, reused after the pool reset
+    uint32_t commandBufferCount[MAX_FRAMES_IN_FLIGHT];
+    uint32_t usedCount[MAX_FRAMES_IN_FLIGHT]; // secondaries recorded since the last reset
+} MyRecordThread;
+
+typedef struct MyRecordWorkers
+{
+    SDL_Thread *workers[RECORD_MAX_WORKERS];
+    uint32_t workerCount;
+    MyRecordThread threads[RECORD_MAX_WORKERS + 1]; // the last one is the main thread
+    SDL_mutex *lock;
+    SDL_cond *jobQueued;
+    SDL_cond *jobDone;
+    // Batch being recorded, jobs are started in order and executed in order
+    const VkCommandBufferInheritanceInfo *inheritance;
+    MyRecordFunc record;
+    void *userData;
+    uint32_t frameInFlightIndex;
+    uint32_t drawCount;
+    uint32_t jobCount;
+    uint32_t startedCount;
+    uint32_t doneCount;
+    VkCommandBuffer jobCommandBuffers[RECORD_MAX_WORKERS + 1];
+    uint8_t quit;
+} MyRecordWorkers;
+
+typedef struct MyPipelineShader
+{
+    char name[PIPELINE_SHADER_NAME_SIZE]; // shader registry name, like "base.vert"
+    VkShaderStageFlagBits stage;
+} MyPipelineShader;
+
+// VkDescriptorSetLayoutBinding without the immutable samplers pointer, so the layout can be hashed
+typedef struct MyDescriptorBindingDesc
+{
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t count;
+    VkShaderStageFlags stages;
+} MyDescriptorBindingDesc;
+
+typedef struct MyDescriptorSetLayoutDesc
+{
+    MyDescriptorBindingDesc bindings[PIPELINE_MAX_SET_BINDINGS]; // sorted by binding number
+    uint32_t bindingCount;
+} MyDescriptorSetLayoutDesc;
+
+typedef struct MyPipelineLayoutDesc
+{
+    MyDescriptorSetLayoutDesc sets[PIPELINE_MAX_DESCRIPTOR_SETS];
+    uint32_t setCount;
+    VkPushConstantRange pushConstantRanges[PIPELINE_MAX_PUSH_CONSTANT_RANGES];
+    uint32_t pushConstantRangeCount;
+} MyPipelineLayoutDesc;
+
+// Full graphics pipeline state, must be initialized by init_vulkan_pipeline_desc so the padding is zero.
+// The 8 bytes render pass handle goes first, all the other members are 4 bytes.
+typedef struct MyPipelineDesc
+{
+    VkRenderPass renderPass; // VK_NULL_HANDLE for dynamic rendering with colorFormats
+    uint32_t subpass;
+    MyPipelineShader shaders[PIPELINE_MAX_SHADER_STAGES];
+    uint32_t shaderCount;
+    VkVertexInputBindingDescription vertexBindings[PIPELINE_MAX_VERTEX_BINDINGS];
+    uint32_t vertexBindingCount;
+    VkVertexInputAttributeDescription vertexAttributes[PIPELINE_MAX_VERTEX_ATTRIBUTES];
+    uint32_t vertexAttributeCount;
+    VkPrimitiveTopology topology;
+    VkPolygonMode polygonMode;
+    VkCullModeFlags cullMode;
+    VkFrontFace frontFace;
+    VkSampleCountFlagBits samples;
+    VkFormat colorFormats[PIPELINE_MAX_COLOR_ATTACHMENTS];
+    VkPipelineColorBlendAttachmentState blendAttachments[PIPELINE_MAX_COLOR_ATTACHMENTS];
+    uint32_t colorAttachmentCount;
+    VkDynamicState dynamicStates[PIPELINE_MAX_DYNAMIC_STATES];
+    uint32_t dynamicStateCount;
+    MyPipelineLayoutDesc layout;
+} MyPipelineDesc;
+
+typedef struct MyPipelineLibrary MyPipelineLibrary;
+
+typedef struct MyPipelineEntry
+{
+    uint64_t hash;
+    MyPipelineDesc desc;
+    VkPipelineLayout layout;
+    VkPipeline pipeline; // VK_NULL_HANDLE while the build job is running
+    uint32_t buildHandle;
+    // shader hot reload, the rebuilt pipeline replaces the current one at a frame boundary
+    uint32_t reloadHandle;
+    uint8_t reloadPending;
+    uint8_t reloadDirty; // shader changed while the first build or a rebuild was running
+    // graphics pipeline library path, the fast linked pipeline is replaced by an optimized link compiled in the background
+    VkPipeline libraries[PIPELINE_LIBRARY_PART_COUNT];
+    MyPipelineLibrary *linkLibraries[PIPELINE_LIBRARY_PART_COUNT]; // parts still compiling when the entry was requested
+    uint8_t linkPending; // fast linked once all of linkLibraries are built
+    uint8_t optimizing;
+} MyPipelineEntry;
+
+struct MyPipelineLibrary
+{
+    uint64_t hash;
+    VkGraphicsPipelineLibraryFlagsEXT part;
+    MyPipelineDesc key; // pipeline description with only the state of this part
+    VkPipelineLayout layout;
+    VkPipeline library; // VK_NULL_HANDLE while the build job is running or if the part failed to compile
+    uint32_t buildHandle;
+    uint8_t pending;
+};
+
+typedef struct MySharedPipelineLayout
+{
+    MyPipelineLayoutDesc desc;
+    VkDescriptorSetLayout setLayouts[PIPELINE_MAX_DESCRIPTOR_SETS];
+    VkPipelineLayout layout;
+} MySharedPipelineLayout;
+
+typedef struct MyPipelineTable
+{
+    // entries are allocated one by one so the build jobs can keep a pointer while the table grows
+    MyPipelineEntry **entries;
+    uint32_t entryCount;
+    uint32_t entryCapacity;
+    // open addressing, entry index + 1, 0 is an empty bucket
+    uint32_t *buckets;
+    uint32_t bucketCount;
+    // pipeline layouts shared by all entries with a layout description they cover
+    MySharedPipelineLayout *layouts;
+    uint32_t layoutCount;
+    uint32_t requestCount;
+    // libraries are allocated one by one like the entries, their build jobs keep a pointer
+    MyPipelineLibrary **libraries;
+    uint32_t libraryCount;
+    uint32_t libraryCapacity;
+    // libraries of changed shaders, destroyed once no optimized or pending link uses them
+    MyPipelineLibrary **staleLibraries;
+    uint32_t staleLibraryCount;
+    uint32_t linkCount;
+    uint32_t pendingLinkCount;
+    // pipeline of the last draw state switch, it replaces context->graphicsPipeline once built
+    uint32_t drawStatePipeline;
+    uint8_t drawStatePending;
+} MyPipelineTable;
+
+// Shaders of a pipeline description created as linked VK_EXT_shader_object shaders
+typedef struct MyShaderObjects
+{
+    VkShaderEXT shaders[PIPELINE_MAX_SHADER_STAGES]; // vertex, geometry, fragment, VK_NULL_HANDLE for unused stages
+    uint32_t shaderCount;
+} MyShaderObjects;
+
 typedef struct MyDeviceFeatures
 {
     VkPhysicalDeviceFeatures features;
@@ -54,6 +443,11 @@ typedef struct MyDeviceFeatures
     uint8_t debugUtilsSupport;
     uint8_t validationFeaturesSupport;
     uint8_t swapchainMaintenance1Support;
+    uint8_t memoryBudgetSupport;
+    uint8_t graphicsPipelineLibrarySupport; // VK_EXT_graphics_pipeline_library with fast linking
+    uint8_t shaderObjectSupport; // VK_EXT_shader_object
+    uint8_t extendedDynamicState3Support; // VK_EXT_extended_dynamic_state3 with dynamic polygon mode and color blend
+    uint32_t shaderVariantFeatures; // SHADER_FEATURE_* bits enabled on the device, see select_vulkan_shader_variant
     uint8_t portabilityEnumerationSupport;
     uint8_t portabilitySubsetSupport;
 } MyDeviceFeatures;
@@ -80,8 +474,46 @@ typedef struct MySwapchainInfo
     VkSwapchainKHR swapchain;
     uint32_t imageCount;
     MySwapchainFramebuffer *framebuffers;
+    uint8_t outOfDate; // recreated before the next acquire, set by window size changes and acquire or present results
+    uint64_t firstAcquireFrame; // frame number of the first image acquired from this swapchain, UINT64_MAX before
 } MySwapchainInfo;
 
+#define DEFERRED_DESTROY_BUFFER     0
+#define DEFERRED_DESTROY_IMAGE      1
+#define DEFERRED_DESTROY_IMAGE_VIEW 2
+#define DEFERRED_DESTROY_PIPELINE   3
+#define DEFERRED_DESTROY_SWAPCHAIN  4
+
+typedef struct MyDeferredDestroy
+{
+    uint32_t type;
+    uint64_t timelineValue; // frame timeline value after which the GPU no longer uses the object
+    union
+    {
+        VBuffer buffer;
+        struct
+        {
+            VkImage image;
+            MyMemoryAllocation allocation;
+        } image;
+        VkImageView imageView;
+        VkPipeline pipeline;
+        struct
+        {
+            VkSwapchainKHR swapchain;
+            MySwapchainFramebuffer *framebuffers; // also waits for the present fences of the images
+            uint32_t imageCount;
+        } swapchain;
+    } object;
+} MyDeferredDestroy;
+
+typedef struct MyDestroyQueue
+{
+    MyDeferredDestroy *entries; // in queuing order, so by timeline value
+    uint32_t count;
+    uint32_t capacity;
+} MyDestroyQueue;
+
 typedef struct MyFrameStats
 {
     uint64_t timerFreq;
@@ -89,20 +521,39 @@ typedef struct MyFrameStats
     uint64_t startTimerTick;
     uint64_t framesPerSecond;
     uint64_t frameNumber;
+    uint64_t completedFrameCount; // frames with a lower frameNumber finished executing, last frame timeline value read
+    uint64_t submittedFrameCount; // frame timeline value of the last submit, frames may be skipped while minimized
     uint32_t frameInFlightIndex;
 } MyFrameStats;
 
+// Frames in flight, fixed or tuned from the CPU record time and the GPU time seen at the frame timeline waits
+typedef struct MyFramePacing
+{
+    uint32_t frameInFlightCount; // 1 to MAX_FRAMES_IN_FLIGHT
+    uint8_t autoTune;
+    uint64_t lastCompletionTick; // when the previous waited frame was seen finished
+    uint64_t cpuTicks[FRAME_PACING_SAMPLES]; // ring of record times
+    uint32_t cpuSampleCount;
+    uint64_t gpuTicks; // sum of the GPU time estimates of the window
+    uint32_t gpuSampleCount;
+} MyFramePacing;
+
 typedef struct MyFrameInFlight
 {
     VkSemaphore imageAvailableSemaphore;
-    VkFence submitCompletedFence;
     VkCommandBuffer commandBuffer;
     uint32_t imageIndex;
+    uint64_t transferWaitValue; // transfer timeline value the frame submit waits for, 0 if none
+    VkPipelineStageFlags2 transferWaitStages;
+    uint64_t submittedFrameCount; // frameNumber + 1 of the last frame submitted with this slot, 0 if none
+    uint64_t submitTick;
 } MyFrameInFlight;
 
-typedef struct MyRenderContext
+struct MyRenderContext
 {
     const char *sampleName;
+    MyHostAllocator hostAllocator;
+    const VkAllocationCallbacks *allocationCallbacks; // passed to every Vulkan create and destroy call
     SDL_Window *window;
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugUtilsMessenger;
@@ -120,15 +571,39 @@ typedef struct MyRenderContext
     VkRenderPass renderPass;
     VkPipelineLayout graphicsPipelineLayout;
     VkPipeline graphicsPipeline;
+    MyPipelineDesc drawState; // state of the draws, the dynamic states of graphicsPipeline are set from it
+    VkPipelineCache pipelineCache;
+    MyPipelineBuilder pipelineBuilder;
+    MyPipelineTable pipelineTable;
+    int shaderWatch; // inotify descriptor, -1 if shader hot reload is off
+    MyShaderObjects shaderObjects;
+    uint8_t useShaderObjects; // bind shaderObjects instead of graphicsPipeline
+    MyRecordWorkers recordWorkers;
+    uint8_t useParallelRecording; // record the draws into secondary command buffers on the record workers
+    uint32_t sceneDrawCount; // draws of the scene, raised with VK_BEGINNER_DRAW_COUNT to load the recording
     VkCommandPool commandPool;
     VkCommandPool transferCommandPool;
+    VkSemaphore frameTimeline; // graphics queue timeline, the submit of a frame signals its frameNumber + 1
+    MyDestroyQueue destroyQueue;
+    VkSemaphore transferTimeline;
+    uint64_t transferTimelineValue; // last value submitted to the transfer queue
+    uint64_t transferCompletedValue; // last value known to be reached
+    MyStagingRing stagingRing;
+    uint32_t uploadPolicy;
+    MyTransientBuffer transientBuffer;
+    MyPendingTransfer pendingTransfers[MAX_PENDING_TRANSFERS];
+    uint32_t firstPendingTransfer;
+    uint32_t pendingTransferCount;
+    uint8_t uploadBatchActive;
     MyFrameStats frameStats;
-    MyFrameInFlight framesInFlight[MAX_FRAMES_IN_FLIGHT];
+    MyFramePacing framePacing;
+    MyFrameInFlight framesInFlight[MAX_FRAMES_IN_FLIGHT]; // the first framePacing.frameInFlightCount are used
+    MyMemoryAllocator memoryAllocator;
     uint8_t isFullscreen;
     MyShaderUniforms shaderUniforms;
     VBuffer vertexBuffer;
     VBuffer indexBuffer;
-} MyRenderContext;
+};
 
 void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFlight);
 
@@ -144,6 +619,10 @@ void create_vulkan_swapchain(MyRenderContext *context);
 void create_vulkan_command_buffers(MyRenderContext *context);
 void draw_frame(MyRenderContext *context);
 void update_frame_stats(MyRenderContext *context);
+// Checks the frame timeline without blocking, the value read is kept in frameStats.completedFrameCount
+int is_vulkan_frame_completed(MyRenderContext *context, uint64_t frameNumber);
+// Blocks until the frame timeline reaches value, i.e. the frames before frameNumber value finished
+void wait_vulkan_frame_timeline(MyRenderContext *context, uint64_t value);
 void resize_sdl2_vulkan_window(MyRenderContext *context);
 void destroy_context(MyRenderContext *context);
 void destroy_auxiliary(MyRenderContext *context);
@@ -0,0 +1,198 @@
+#include "deferred_destroy.h"
+#include "vbuffer.h"
+#include "vmemory.h"
+
+#include <string.h>
+
+#define DESTROY_QUEUE_INITIAL_SIZE 16
+
+static void defer_vulkan_destroy(MyRenderContext *context, MyDeferredDestroy *object)
+{
+    MyDestroyQueue *queue = &context->destroyQueue;
+
+    if (queue->count == queue->capacity)
+    {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : DESTROY_QUEUE_INITIAL_SIZE;
+        queue->entries = realloc(queue->entries, sizeof(MyDeferredDestroy) * queue->capacity);
+    }
+
+    // The current frame may be recording with the object, its submit signals frameNumber + 1
+    object->timelineValue = context->frameStats.frameNumber + 1;
+    queue->entries[queue->count++] = *object;
+}
+
+void defer_vulkan_buffer_destroy(MyRenderContext *context, VBuffer buffer)
+{
+    MyDeferredDestroy object = {0};
+
+    object.type = DEFERRED_DESTROY_BUFFER;
+    object.object.buffer = buffer;
+    defer_vulkan_destroy(context, &object);
+}
+
+void defer_vulkan_image_destroy(MyRenderContext *context, VkImage image, const MyMemoryAllocation *allocation)
+{
+    MyDeferredDestroy object = {0};
+
+    object.type = DEFERRED_DESTROY_IMAGE;
+    object.object.image.image = image;
+    if (allocation)
+    {
+        object.object.image.allocation = *allocation;
+    }
+
+    defer_vulkan_destroy(context, &object);
+}
+
+void defer_vulkan_image_view_destroy(MyRenderContext *context, VkImageView imageView)
+{
+    MyDeferredDestroy object = {0};
+
+    object.type = DEFERRED_DESTROY_IMAGE_VIEW;
+    object.object.imageView = imageView;
+    defer_vulkan_destroy(context, &object);
+}
+
+void defer_vulkan_pipeline_destroy(MyRenderContext *context, VkPipeline pipeline)
+{
+    MyDeferredDestroy object = {0};
+
+    object.type = DEFERRED_DESTROY_PIPELINE;
+    object.object.pipeline = pipeline;
+    defer_vulkan_destroy(context, &object);
+}
+
+void defer_vulkan_swapchain_destroy(MyRenderContext *context, VkSwapchainKHR swapchain, MySwapchainFramebuffer *framebuffers,
+    uint32_t imageCount)
+{
+    MyDeferredDestroy object = {0};
+
+    object.type = DEFERRED_DESTROY_SWAPCHAIN;
+    object.object.swapchain.swapchain = swapchain;
+    object.object.swapchain.framebuffers = framebuffers;
+    object.object.swapchain.imageCount = imageCount;
+    defer_vulkan_destroy(context, &object);
+}
+
+// The frames using a swapchain finished, checks or waits that its images were presented too
+static int wait_vulkan_swapchain_presents(MyRenderContext *context, const MyDeferredDestroy *object, int block)
+{
+    VkResult r;
+    VkFence *fences;
+
+    if (!context->supportedFeatures.swapchainMaintenance1Support)
+    {
+        // Without present fences, the old presents are known to be done once an image acquired from a newer swapchain
+        // came back for reuse: the frame waiting on its acquire completed. The current swapchain is always newer than
+        // the queued ones, if it is replaced again before acquiring, the check moves to its replacement.
+        if (block)
+        {
+            vkQueueWaitIdle(context->presentQueue.queue);
+            return VK_TRUE;
+        }
+
+        return context->swapchainInfo.firstAcquireFrame != UINT64_MAX &&
+            is_vulkan_frame_completed(context, context->swapchainInfo.firstAcquireFrame);
+    }
+
+    fences = malloc(sizeof(VkFence) * object->object.swapchain.imageCount);
+    for (uint32_t i = 0; i < object->object.swapchain.imageCount; i++)
+    {
+        fences[i] = object->object.swapchain.framebuffers[i].presentationCompletedFence;
+    }
+
+    // Images never presented keep their fence created signaled
+    r = vkWaitForFences(context->logicalDevice, object->object.swapchain.imageCount, fences, VK_TRUE, block ? UINT64_MAX : 0);
+    free(fences);
+
+    if (r != VK_TIMEOUT)
+    {
+        CHECK_VK(r);
+    }
+
+    return r == VK_SUCCESS;
+}
+
+static void destroy_vulkan_deferred_object(MyRenderContext *context, MyDeferredDestroy *object)
+{
+    MySwapchainFramebuffer *framebuffers;
+
+    switch (object->type)
+    {
+    case DEFERRED_DESTROY_BUFFER:
+        destroy_vulkan_buffer(context, object->object.buffer);
+        break;
+    case DEFERRED_DESTROY_IMAGE:
+        vkDestroyImage(context->logicalDevice, object->object.image.image, context->allocationCallbacks);
+        free_vulkan_memory(context, &object->object.image.allocation);
+        break;
+    case DEFERRED_DESTROY_IMAGE_VIEW:
+        vkDestroyImageView(context->logicalDevice, object->object.imageView, context->allocationCallbacks);
+        break;
+    case DEFERRED_DESTROY_PIPELINE:
+        vkDestroyPipeline(context->logicalDevice, object->object.pipeline, context->allocationCallbacks);
+        break;
+    case DEFERRED_DESTROY_SWAPCHAIN:
+        framebuffers = object->object.swapchain.framebuffers;
+        for (uint32_t i = 0; i < object->object.swapchain.imageCount; i++)
+        {
+            vkDestroyFramebuffer(context->logicalDevice, framebuffers[i].framebuffer, context->allocationCallbacks);
+            vkDestroyImageView(context->logicalDevice, framebuffers[i].imageView, context->allocationCallbacks);
+            vkDestroySemaphore(context->logicalDevice, framebuffers[i].presentationSemaphore, context->allocationCallbacks);
+            vkDestroyFence(context->logicalDevice, framebuffers[i].presentationCompletedFence, context->allocationCallbacks);
+        }
+
+        free(framebuffers);
+        vkDestroySwapchainKHR(context->logicalDevice, object->object.swapchain.swapchain, context->allocationCallbacks);
+        break;
+    }
+}
+
+void update_vulkan_destroy_queue(MyRenderContext *context)
+{
+    MyDestroyQueue *queue = &context->destroyQueue;
+    MyDeferredDestroy *object;
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < queue->count; i++)
+    {
+        object = queue->entries + i;
+
+        // Entries are queued in timeline order, the first one not reached ends the scan
+        if (!is_vulkan_frame_completed(context, object->timelineValue - 1))
+        {
+            memmove(queue->entries + kept, object, sizeof(MyDeferredDestroy) * (queue->count - i));
+            kept += queue->count - i;
+            break;
+        }
+
+        if (object->type == DEFERRED_DESTROY_SWAPCHAIN && !wait_vulkan_swapchain_presents(context, object, VK_FALSE))
+        {
+            queue->entries[kept++] = *object;
+            continue;
+        }
+
+        destroy_vulkan_deferred_object(context, object);
+    }
+
+    queue->count = kept;
+}
+
+void flush_vulkan_destroy_queue(MyRenderContext *context)
+{
+    MyDestroyQueue *queue = &context->destroyQueue;
+
+    for (uint32_t i = 0; i < queue->count; i++)
+    {
+        wait_vulkan_frame_timeline(context, queue->entries[i].timelineValue);
+        if (queue->entries[i].type == DEFERRED_DESTROY_SWAPCHAIN)
+        {
+            wait_vulkan_swapchain_presents(context, queue->entries + i, VK_TRUE);
+        }
+
+        destroy_vulkan_deferred_object(context, queue->entries + i);
+    }
+
+    free(queue->entries);
+    memset(queue, 0, sizeof(MyDestroyQueue));
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+
+// Deferred destruction: objects the frames recorded so far, the current one included, may still use are queued
+// with the next frame timeline value and destroyed once the GPU reached it. Nothing waits for the device to idle.
+void defer_vulkan_buffer_destroy(MyRenderContext *context, VBuffer buffer);
+// allocation is optional, the memory bound to the image is freed with it
+void defer_vulkan_image_destroy(MyRenderContext *context, VkImage image, const MyMemoryAllocation *allocation);
+void defer_vulkan_image_view_destroy(MyRenderContext *context, VkImageView imageView);
+void defer_vulkan_pipeline_destroy(MyRenderContext *context, VkPipeline pipeline);
+// The framebuffers array is freed with the swapchain, once its images were presented as well
+void defer_vulkan_swapchain_destroy(MyRenderContext *context, VkSwapchainKHR swapchain, MySwapchainFramebuffer *framebuffers,
+    uint32_t imageCount);
+// Destroys the objects whose frames finished, called at the top of draw_frame
+void update_vulkan_destroy_queue(MyRenderContext *context);
+// Waits for every queued object and destroys it, called on shutdown
+void flush_vulkan_destroy_queue(MyRenderContext *context);
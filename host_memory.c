@@ -0,0 +1,287 @@
+#include "host_memory.h"
+
+#include <string.h>
+
+// Every allocation is prefixed by a header, its size keeps the user pointer 16 bytes aligned
+#define HOST_MEMORY_HEADER_SIZE     32
+#define HOST_MEMORY_MIN_ALIGNMENT   16
+#define HOST_MEMORY_MIN_POOL_CLASS  16
+#define HOST_MEMORY_NO_POOL_CLASS   0xff
+
+typedef struct MyHostMemoryHeader
+{
+    void *raw; // pointer returned by malloc or the pool slot
+    size_t size;
+    uint8_t scope;
+    uint8_t poolClass;
+} MyHostMemoryHeader;
+
+static const char *scopeNames[HOST_MEMORY_SCOPE_COUNT] = {
+    "command",
+    "object",
+    "cache",
+    "device",
+    "instance"
+};
+
+static uint8_t get_pool_class(size_t size, size_t alignment)
+{
+    size_t classSize = HOST_MEMORY_MIN_POOL_CLASS;
+
+    if (alignment > HOST_MEMORY_MIN_ALIGNMENT)
+    {
+        return HOST_MEMORY_NO_POOL_CLASS;
+    }
+
+    for (uint8_t i = 0; i < HOST_MEMORY_POOL_CLASSES; i++, classSize *= 2)
+    {
+        if (size <= classSize)
+        {
+            return i;
+        }
+    }
+
+    return HOST_MEMORY_NO_POOL_CLASS;
+}
+
+static void *allocate_pool_slot(MyHostAllocator *allocator, uint8_t poolClass)
+{
+    size_t slotSize = HOST_MEMORY_HEADER_SIZE + ((size_t)HOST_MEMORY_MIN_POOL_CLASS << poolClass);
+    void *slot;
+
+    if ((slot = allocator->freeSlots[poolClass]) != NULL)
+    {
+        // Free slots are linked through their first bytes
+        allocator->freeSlots[poolClass] = *(void **)slot;
+        return slot;
+    }
+
+    if (allocator->chunkRemaining < slotSize)
+    {
+        uint8_t *chunk = malloc(HOST_MEMORY_POOL_CHUNK_SIZE);
+        if (!chunk)
+        {
+            return NULL;
+        }
+
+        // The first header sized piece of a chunk links it to the list of chunks
+        *(void **)chunk = allocator->chunks;
+        allocator->chunks = chunk;
+        allocator->chunkCursor = chunk + HOST_MEMORY_HEADER_SIZE;
+        allocator->chunkRemaining = HOST_MEMORY_POOL_CHUNK_SIZE - HOST_MEMORY_HEADER_SIZE;
+        allocator->poolBytes += HOST_MEMORY_POOL_CHUNK_SIZE;
+    }
+
+    slot = allocator->chunkCursor;
+    allocator->chunkCursor += slotSize;
+    allocator->chunkRemaining -= slotSize;
+    return slot;
+}
+
+static void update_stats_on_allocation(MyHostMemoryStats *stats, size_t size)
+{
+    stats->currentBytes += size;
+    stats->peakBytes = MAX(stats->peakBytes, stats->currentBytes);
+    stats->allocationCount++;
+    stats->liveCount++;
+}
+
+static void update_stats_on_free(MyHostMemoryStats *stats, size_t size)
+{
+    stats->currentBytes -= size;
+    stats->liveCount--;
+}
+
+static void *host_allocate(MyHostAllocator *allocator, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    MyHostMemoryHeader *header;
+    uint8_t *raw, *memory;
+    uint8_t poolClass = allocator->usePool ? get_pool_class(size, alignment) : HOST_MEMORY_NO_POOL_CLASS;
+
+    alignment = MAX(alignment, HOST_MEMORY_MIN_ALIGNMENT);
+    if (poolClass != HOST_MEMORY_NO_POOL_CLASS)
+    {
+        raw = allocate_pool_slot(allocator, poolClass);
+        memory = raw ? raw + HOST_MEMORY_HEADER_SIZE : NULL;
+    }
+    else
+    {
+        raw = malloc(size + HOST_MEMORY_HEADER_SIZE + alignment - 1);
+        memory = raw ? (uint8_t *)ALIGN_UP((uintptr_t)(raw + HOST_MEMORY_HEADER_SIZE), alignment) : NULL;
+    }
+
+    if (!memory)
+    {
+        return NULL;
+    }
+
+    header = (MyHostMemoryHeader *)(memory - HOST_MEMORY_HEADER_SIZE);
+    header->raw = raw;
+    header->size = size;
+    header->scope = (uint8_t)scope;
+    header->poolClass = poolClass;
+
+    update_stats_on_allocation(&allocator->scopes[scope], size);
+    update_stats_on_allocation(&allocator->total, size);
+    return memory;
+}
+
+static void host_free(MyHostAllocator *allocator, void *memory)
+{
+    MyHostMemoryHeader *header = (MyHostMemoryHeader *)((uint8_t *)memory - HOST_MEMORY_HEADER_SIZE);
+
+    update_stats_on_free(&allocator->scopes[header->scope], header->size);
+    update_stats_on_free(&allocator->total, header->size);
+
+    if (header->poolClass != HOST_MEMORY_NO_POOL_CLASS)
+    {
+        *(void **)header->raw = allocator->freeSlots[header->poolClass];
+        allocator->freeSlots[header->poolClass] = header->raw;
+    }
+    else
+    {
+        free(header->raw);
+    }
+}
+
+static VKAPI_ATTR void *VKAPI_CALL host_allocation_callback(void *pUserData, size_t size, size_t alignment,
+    VkSystemAllocationScope allocationScope)
+{
+    MyHostAllocator *allocator = pUserData;
+    void *memory;
+
+    SDL_AtomicLock(&allocator->lock);
+    memory = host_allocate(allocator, size, alignment, allocationScope);
+    SDL_AtomicUnlock(&allocator->lock);
+    return memory;
+}
+
+static VKAPI_ATTR void *VKAPI_CALL host_reallocation_callback(void *pUserData, void *pOriginal, size_t size, size_t alignment,
+    VkSystemAllocationScope allocationScope)
+{
+    MyHostAllocator *allocator = pUserData;
+    void *memory = NULL;
+
+    SDL_AtomicLock(&allocator->lock);
+    if (size > 0)
+    {
+        memory = host_allocate(allocator, size, alignment, allocationScope);
+    }
+
+    // On failure the original allocation must stay untouched
+    if (pOriginal && (memory || size == 0))
+    {
+        MyHostMemoryHeader *header = (MyHostMemoryHeader *)((uint8_t *)pOriginal - HOST_MEMORY_HEADER_SIZE);
+
+        if (memory)
+        {
+            memcpy(memory, pOriginal, MIN(size, header->size));
+        }
+
+        host_free(allocator, pOriginal);
+    }
+
+    SDL_AtomicUnlock(&allocator->lock);
+    return memory;
+}
+
+static VKAPI_ATTR void VKAPI_CALL host_free_callback(void *pUserData, void *pMemory)
+{
+    MyHostAllocator *allocator = pUserData;
+
+    if (!pMemory)
+    {
+        return;
+    }
+
+    SDL_AtomicLock(&allocator->lock);
+    host_free(allocator, pMemory);
+    SDL_AtomicUnlock(&allocator->lock);
+}
+
+static VKAPI_ATTR void VKAPI_CALL host_internal_allocation_callback(void *pUserData, size_t size,
+    VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+{
+    MyHostAllocator *allocator = pUserData;
+
+    SDL_AtomicLock(&allocator->lock);
+    allocator->scopes[allocationScope].internalBytes += size;
+    allocator->total.internalBytes += size;
+    SDL_AtomicUnlock(&allocator->lock);
+}
+
+static VKAPI_ATTR void VKAPI_CALL host_internal_free_callback(void *pUserData, size_t size,
+    VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+{
+    MyHostAllocator *allocator = pUserData;
+
+    SDL_AtomicLock(&allocator->lock);
+    allocator->scopes[allocationScope].internalBytes -= size;
+    allocator->total.internalBytes -= size;
+    SDL_AtomicUnlock(&allocator->lock);
+}
+
+void create_vulkan_host_allocator(MyRenderContext *context, uint8_t usePool)
+{
+    MyHostAllocator *allocator = &context->hostAllocator;
+
+    memset(allocator, 0, sizeof(MyHostAllocator));
+    SDL_assert(sizeof(MyHostMemoryHeader) <= HOST_MEMORY_HEADER_SIZE);
+
+    allocator->usePool = usePool;
+    allocator->callbacks.pUserData = allocator;
+    allocator->callbacks.pfnAllocation = host_allocation_callback;
+    allocator->callbacks.pfnReallocation = host_reallocation_callback;
+    allocator->callbacks.pfnFree = host_free_callback;
+    allocator->callbacks.pfnInternalAllocation = host_internal_allocation_callback;
+    allocator->callbacks.pfnInternalFree = host_internal_free_callback;
+
+    context->allocationCallbacks = &allocator->callbacks;
+}
+
+void destroy_vulkan_host_allocator(MyRenderContext *context)
+{
+    MyHostAllocator *allocator = &context->hostAllocator;
+
+    if (allocator->total.liveCount > 0)
+    {
+        fprintf(stderr, "Host allocator destroyed with %llu live allocations (%zu bytes)\n",
+            (unsigned long long)allocator->total.liveCount, allocator->total.currentBytes);
+    }
+
+    while (allocator->chunks)
+    {
+        void *chunk = allocator->chunks;
+        allocator->chunks = *(void **)chunk;
+        free(chunk);
+    }
+
+    memset(allocator, 0, sizeof(MyHostAllocator));
+    context->allocationCallbacks = NULL;
+}
+
+void print_vulkan_host_allocator_stats(MyRenderContext *context)
+{
+    MyHostAllocator *allocator = &context->hostAllocator;
+
+    SDL_AtomicLock(&allocator->lock);
+    printf("Vulkan host memory (%s):\n", allocator->usePool ? "pool" : "malloc");
+
+    for (uint32_t i = 0; i < HOST_MEMORY_SCOPE_COUNT; i++)
+    {
+        printf("\t%-8s current %zu bytes, peak %zu bytes, internal %zu bytes, %llu allocations, %llu live\n", scopeNames[i],
+            allocator->scopes[i].currentBytes, allocator->scopes[i].peakBytes, allocator->scopes[i].internalBytes,
+            (unsigned long long)allocator->scopes[i].allocationCount, (unsigned long long)allocator->scopes[i].liveCount);
+    }
+
+    printf("\t%-8s current %zu bytes, peak %zu bytes, internal %zu bytes, %llu allocations, %llu live\n", "total",
+        allocator->total.currentBytes, allocator->total.peakBytes, allocator->total.internalBytes,
+        (unsigned long long)allocator->total.allocationCount, (unsigned long long)allocator->total.liveCount);
+
+    if (allocator->usePool)
+    {
+        printf("\tpool chunks %zu bytes\n", allocator->poolBytes);
+    }
+
+    SDL_AtomicUnlock(&allocator->lock);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common.h"
+
+// Vulkan host allocator with per allocation scope statistics, small allocations are served
+// from size class pools if usePool is set
+void create_vulkan_host_allocator(MyRenderContext *context, uint8_t usePool);
+void destroy_vulkan_host_allocator(MyRenderContext *context);
+void print_vulkan_host_allocator_stats(MyRenderContext *context);
@@ -0,0 +1,239 @@
+#include "pipeline_builder.h"
+
+#include <string.h>
+
+// Called with the lock held, the workers only keep slot indices across unlocks so the arrays can move
+static void grow_pipeline_jobs(MyPipelineBuilder *builder)
+{
+    uint32_t capacity = builder->jobCapacity ? builder->jobCapacity * 2 : PIPELINE_BUILDER_INITIAL_JOBS;
+    uint32_t *queue;
+
+    if (capacity > PIPELINE_HANDLE_INDEX_MASK + 1)
+    {
+        fprintf(stderr, "Too many pipeline builds waiting to be collected\n");
+        exit(1);
+    }
+
+    builder->jobs = realloc(builder->jobs, sizeof(MyPipelineJob) * capacity);
+    builder->freeSlots = realloc(builder->freeSlots, sizeof(uint32_t) * capacity);
+    queue = malloc(sizeof(uint32_t) * capacity);
+    if (!builder->jobs || !builder->freeSlots || !queue)
+    {
+        fprintf(stderr, "Failed to allocate pipeline builder jobs\n");
+        exit(1);
+    }
+
+    memset(builder->jobs + builder->jobCapacity, 0, sizeof(MyPipelineJob) * (capacity - builder->jobCapacity));
+
+    // Unwrap the ring of queued jobs at the start of the larger one
+    for (uint32_t i = 0; i < builder->queueCount; i++)
+    {
+        queue[i] = builder->queue[(builder->queueHead + i) % builder->jobCapacity];
+    }
+
+    free(builder->queue);
+    builder->queue = queue;
+    builder->queueHead = 0;
+
+    // Lower slots are handed out first
+    for (uint32_t i = capacity; i > builder->jobCapacity; i--)
+    {
+        builder->freeSlots[builder->freeCount++] = i - 1;
+    }
+
+    builder->jobCapacity = capacity;
+}
+
+static MyPipelineJob *get_pipeline_job(MyPipelineBuilder *builder, MyPipelineHandle handle)
+{
+    MyPipelineJob *job = &builder->jobs[handle & PIPELINE_HANDLE_INDEX_MASK];
+
+    // A handle already collected points to a free or reused slot of another generation
+    SDL_assert(job->state != PIPELINE_JOB_FREE && handle >> PIPELINE_HANDLE_INDEX_BITS ==
+        (job->generation & (UINT32_MAX >> PIPELINE_HANDLE_INDEX_BITS)));
+    return job;
+}
+
+static void free_pipeline_job(MyPipelineBuilder *builder, MyPipelineHandle handle)
+{
+    MyPipelineJob *job = &builder->jobs[handle & PIPELINE_HANDLE_INDEX_MASK];
+
+    job->state = PIPELINE_JOB_FREE;
+    job->generation++;
+    builder->freeSlots[builder->freeCount++] = handle & PIPELINE_HANDLE_INDEX_MASK;
+}
+
+static int pipeline_worker(void *data)
+{
+    MyRenderContext *context = data;
+    MyPipelineBuilder *builder = &context->pipelineBuilder;
+    MyPipelineBuildFunc build;
+    void *userData;
+    uint32_t slot;
+    VkPipeline pipeline;
+
+    SDL_LockMutex(builder->lock);
+    for (;;)
+    {
+        while (!builder->quit && builder->queueCount == 0)
+        {
+            SDL_CondWait(builder->jobQueued, builder->lock);
+        }
+
+        if (builder->quit)
+        {
+            break;
+        }
+
+        // Jobs are started in the submit order
+        slot = builder->queue[builder->queueHead];
+        builder->queueHead = (builder->queueHead + 1) % builder->jobCapacity;
+        builder->queueCount--;
+        builder->jobs[slot].state = PIPELINE_JOB_RUNNING;
+        build = builder->jobs[slot].build;
+        userData = builder->jobs[slot].userData;
+        SDL_UnlockMutex(builder->lock);
+
+        pipeline = build(context, userData);
+
+        SDL_LockMutex(builder->lock);
+        builder->jobs[slot].pipeline = pipeline;
+        builder->jobs[slot].state = PIPELINE_JOB_DONE;
+        SDL_CondBroadcast(builder->jobDone);
+    }
+
+    SDL_UnlockMutex(builder->lock);
+    return 0;
+}
+
+void create_vulkan_pipeline_builder(MyRenderContext *context)
+{
+    MyPipelineBuilder *builder = &context->pipelineBuilder;
+
+    builder->lock = SDL_CreateMutex();
+    builder->jobQueued = SDL_CreateCond();
+    builder->jobDone = SDL_CreateCond();
+    if (!builder->lock || !builder->jobQueued || !builder->jobDone)
+    {
+        fprintf(stderr, "Failed to create pipeline builder synchronization: %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    grow_pipeline_jobs(builder);
+
+    // The main thread keeps initializing the swapchain and uploading meshes meanwhile
+    builder->workerCount = CLAMP(SDL_GetCPUCount() - 1, 1, PIPELINE_BUILDER_MAX_WORKERS);
+    for (uint32_t i = 0; i < builder->workerCount; i++)
+    {
+        if ((builder->workers[i] = SDL_CreateThread(pipeline_worker, "pipeline_worker", context)) == NULL)
+        {
+            fprintf(stderr, "Failed to create pipeline worker: %s\n", SDL_GetError());
+            exit(1);
+        }
+    }
+}
+
+void destroy_vulkan_pipeline_builder(MyRenderContext *context)
+{
+    MyPipelineBuilder *builder = &context->pipelineBuilder;
+
+    if (!builder->lock)
+    {
+        return;
+    }
+
+    // Let the running jobs finish, the queued ones are dropped
+    SDL_LockMutex(builder->lock);
+    builder->quit = VK_TRUE;
+    SDL_CondBroadcast(builder->jobQueued);
+    SDL_UnlockMutex(builder->lock);
+
+    for (uint32_t i = 0; i < builder->workerCount; i++)
+    {
+        SDL_WaitThread(builder->workers[i], NULL);
+    }
+
+    // Pipelines built but never collected
+    for (uint32_t i = 0; i < builder->jobCapacity; i++)
+    {
+        if (builder->jobs[i].state == PIPELINE_JOB_DONE)
+        {
+            vkDestroyPipeline(context->logicalDevice, builder->jobs[i].pipeline, context->allocationCallbacks);
+        }
+    }
+
+    free(builder->jobs);
+    free(builder->freeSlots);
+    free(builder->queue);
+
+    SDL_DestroyCond(builder->jobDone);
+    SDL_DestroyCond(builder->jobQueued);
+    SDL_DestroyMutex(builder->lock);
+    memset(builder, 0, sizeof(MyPipelineBuilder));
+}
+
+MyPipelineHandle submit_vulkan_pipeline_build(MyRenderContext *context, MyPipelineBuildFunc build, void *userData)
+{
+    MyPipelineBuilder *builder = &context->pipelineBuilder;
+    MyPipelineHandle handle;
+    MyPipelineJob *job;
+    uint32_t slot;
+
+    SDL_LockMutex(builder->lock);
+    // Only the caller collects jobs, waiting for a slot here could never end
+    if (builder->freeCount == 0)
+    {
+        grow_pipeline_jobs(builder);
+    }
+
+    slot = builder->freeSlots[--builder->freeCount];
+    job = &builder->jobs[slot];
+    job->build = build;
+    job->userData = userData;
+    job->pipeline = VK_NULL_HANDLE;
+    job->state = PIPELINE_JOB_QUEUED;
+    handle = (job->generation << PIPELINE_HANDLE_INDEX_BITS) | slot;
+
+    builder->queue[(builder->queueHead + builder->queueCount++) % builder->jobCapacity] = slot;
+
+    SDL_CondSignal(builder->jobQueued);
+    SDL_UnlockMutex(builder->lock);
+    return handle;
+}
+
+VkPipeline wait_vulkan_pipeline_build(MyRenderContext *context, MyPipelineHandle handle)
+{
+    MyPipelineBuilder *builder = &context->pipelineBuilder;
+    VkPipeline pipeline;
+
+    SDL_LockMutex(builder->lock);
+    // The job array may grow while waiting, the job is looked up again after each wake up
+    while (get_pipeline_job(builder, handle)->state != PIPELINE_JOB_DONE)
+    {
+        SDL_CondWait(builder->jobDone, builder->lock);
+    }
+
+    pipeline = get_pipeline_job(builder, handle)->pipeline;
+    free_pipeline_job(builder, handle);
+    SDL_UnlockMutex(builder->lock);
+    return pipeline;
+}
+
+uint8_t poll_vulkan_pipeline_build(MyRenderContext *context, MyPipelineHandle handle, VkPipeline *pipeline)
+{
+    MyPipelineBuilder *builder = &context->pipelineBuilder;
+    MyPipelineJob *job;
+    uint8_t done = VK_FALSE;
+
+    SDL_LockMutex(builder->lock);
+    job = get_pipeline_job(builder, handle);
+    if (job->state == PIPELINE_JOB_DONE)
+    {
+        *pipeline = job->pipeline;
+        free_pipeline_job(builder, handle);
+        done = VK_TRUE;
+    }
+
+    SDL_UnlockMutex(builder->lock);
+    return done;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "common.h"
+
+typedef uint32_t MyPipelineHandle;
+
+// Worker threads compile the submitted pipelines against the shared context->pipelineCache,
+// VkPipelineCache is internally synchronized so the workers do not lock around it
+void create_vulkan_pipeline_builder(MyRenderContext *context);
+void destroy_vulkan_pipeline_builder(MyRenderContext *context);
+// Never blocks, the job array grows when every slot holds a job not collected yet
+MyPipelineHandle submit_vulkan_pipeline_build(MyRenderContext *context, MyPipelineBuildFunc build, void *userData);
+// Collects the pipeline of a finished job, the handle is invalid afterwards
+VkPipeline wait_vulkan_pipeline_build(MyRenderContext *context, MyPipelineHandle handle);
+// Non blocking version of wait_vulkan_pipeline_build, returns VK_FALSE if the job is still running
+uint8_t poll_vulkan_pipeline_build(MyRenderContext *context, MyPipelineHandle handle, VkPipeline *pipeline);
@@ -0,0 +1,196 @@
+#include "pipeline_cache.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define PIPELINE_CACHE_ORGANIZATION "vulkan_beginner"
+#define PIPELINE_CACHE_APPLICATION  "pipeline_cache"
+#define PIPELINE_CACHE_PATH_MAX     1024
+#define PIPELINE_CACHE_NAME_MAX     128
+
+static int get_pipeline_cache_path(const MyRenderContext *context, char *path, size_t pathSize)
+{
+    char *prefPath;
+    char fileName[PIPELINE_CACHE_NAME_MAX];
+    size_t i;
+
+    // Per user writable directory, e.g. ~/.local/share/vulkan_beginner/pipeline_cache/
+    if ((prefPath = SDL_GetPrefPath(PIPELINE_CACHE_ORGANIZATION, PIPELINE_CACHE_APPLICATION)) == NULL)
+    {
+        fprintf(stderr, "Failed to get the pipeline cache directory: %s\n", SDL_GetError());
+        return VK_FALSE;
+    }
+
+    // The sample name becomes the file name, keep it portable
+    for (i = 0; context->sampleName[i] && i < sizeof(fileName) - 1; i++)
+    {
+        unsigned char c = (unsigned char)context->sampleName[i];
+        fileName[i] = isalnum(c) ? (char)tolower(c) : '_';
+    }
+
+    fileName[i] = '\0';
+    snprintf(path, pathSize, "%s%s.bin", prefPath, fileName);
+    SDL_free(prefPath);
+    return VK_TRUE;
+}
+
+static void *read_pipeline_cache_file(const char *path, size_t *size)
+{
+    FILE *file;
+    long fileSize;
+    void *data;
+
+    // Missing file is a cold start, not an error
+    if ((file = fopen(path, "rb")) == NULL)
+    {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (fileSize = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    data = malloc((size_t)fileSize);
+    if (fread(data, (size_t)fileSize, 1, file) != 1)
+    {
+        fprintf(stderr, "Failed to read pipeline cache %s\n", path);
+        fclose(file);
+        free(data);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = (size_t)fileSize;
+    return data;
+}
+
+static int validate_pipeline_cache_header(const MyRenderContext *context, const void *data, size_t size)
+{
+    VkPhysicalDeviceProperties props;
+    VkPipelineCacheHeaderVersionOne header;
+
+    if (size < sizeof(VkPipelineCacheHeaderVersionOne))
+    {
+        return VK_FALSE;
+    }
+
+    // The data has no alignment guarantees
+    memcpy(&header, data, sizeof(header));
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &props);
+
+    if (header.headerSize < sizeof(VkPipelineCacheHeaderVersionOne) || header.headerSize > size ||
+        header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    {
+        return VK_FALSE;
+    }
+
+    // Cache of another GPU or driver version, the driver would ignore it anyway
+    if (header.vendorID != props.vendorID || header.deviceID != props.deviceID ||
+        memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return VK_FALSE;
+    }
+
+    return VK_TRUE;
+}
+
+static void write_pipeline_cache_file(const char *path, const void *data, size_t size)
+{
+    char tempPath[PIPELINE_CACHE_PATH_MAX + 4];
+    FILE *file;
+    int written;
+
+    // Written next to the old cache and renamed, an interrupted write never leaves a truncated cache behind
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    if ((file = fopen(tempPath, "wb")) == NULL)
+    {
+        fprintf(stderr, "Failed to create pipeline cache %s\n", tempPath);
+        return;
+    }
+
+    written = fwrite(data, size, 1, file) == 1;
+    written = fclose(file) == 0 && written;
+
+#ifdef PLATFORM_Windows
+    // rename does not replace an existing file on Windows
+    if (written)
+    {
+        remove(path);
+    }
+#endif
+
+    if (!written || rename(tempPath, path) != 0)
+    {
+        fprintf(stderr, "Failed to write pipeline cache %s\n", path);
+        remove(tempPath);
+    }
+}
+
+void create_vulkan_pipeline_cache(MyRenderContext *context)
+{
+    VkResult r;
+    VkPipelineCacheCreateInfo cacheInfo = {0};
+    char path[PIPELINE_CACHE_PATH_MAX];
+    void *data = NULL;
+    size_t size = 0;
+
+    if (get_pipeline_cache_path(context, path, sizeof(path)))
+    {
+        data = read_pipeline_cache_file(path, &size);
+    }
+
+    if (data && !validate_pipeline_cache_header(context, data, size))
+    {
+        printf("Pipeline cache %s does not match the device, starting with an empty cache\n", path);
+        free(data);
+        data = NULL;
+        size = 0;
+    }
+    else if (data)
+    {
+        printf("Loaded pipeline cache %s (%zu bytes)\n", path, size);
+    }
+
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = size;
+    cacheInfo.pInitialData = data;
+
+    if (vkCreatePipelineCache(context->logicalDevice, &cacheInfo, context->allocationCallbacks, &context->pipelineCache) != VK_SUCCESS)
+    {
+        // Data passed the header check but the driver still rejected it
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = NULL;
+        CHECK_VK(vkCreatePipelineCache(context->logicalDevice, &cacheInfo, context->allocationCallbacks, &context->pipelineCache));
+    }
+
+    free(data);
+}
+
+void destroy_vulkan_pipeline_cache(MyRenderContext *context)
+{
+    char path[PIPELINE_CACHE_PATH_MAX];
+    void *data;
+    size_t size = 0;
+
+    if (!context->pipelineCache)
+    {
+        return;
+    }
+
+    if (get_pipeline_cache_path(context, path, sizeof(path)) &&
+        vkGetPipelineCacheData(context->logicalDevice, context->pipelineCache, &size, NULL) == VK_SUCCESS && size > 0)
+    {
+        data = malloc(size);
+        if (vkGetPipelineCacheData(context->logicalDevice, context->pipelineCache, &size, data) == VK_SUCCESS)
+        {
+            write_pipeline_cache_file(path, data, size);
+        }
+
+        free(data);
+    }
+
+    vkDestroyPipelineCache(context->logicalDevice, context->pipelineCache, context->allocationCallbacks);
+    context->pipelineCache = VK_NULL_HANDLE;
+}
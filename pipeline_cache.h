@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common.h"
+
+// Pipeline cache persisted in the per user SDL preferences directory, one file per sample.
+// Cache data of another driver or device is dropped and the cache starts empty.
+void create_vulkan_pipeline_cache(MyRenderContext *context);
+// Writes the cache data to a temporary file which is renamed over the old one, then destroys the cache
+void destroy_vulkan_pipeline_cache(MyRenderContext *context);
@@ -0,0 +1,1258 @@
+#include "pipeline_state.h"
+#include "pipeline_builder.h"
+#include "spirv_reflect.h"
+#include "deferred_destroy.h"
+
+#include <string.h>
+
+#define FNV_OFFSET_BASIS    0xcbf29ce484222325ull
+#define FNV_PRIME           0x100000001b3ull
+
+void init_vulkan_pipeline_desc(const MyRenderContext *context, MyPipelineDesc *desc)
+{
+    // Zero the padding as well, the description is hashed and compared as raw bytes
+    memset(desc, 0, sizeof(MyPipelineDesc));
+
+    desc->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    desc->polygonMode = VK_POLYGON_MODE_FILL;
+    desc->cullMode = VK_CULL_MODE_BACK_BIT;
+    desc->frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    desc->samples = VK_SAMPLE_COUNT_1_BIT;
+
+    desc->colorAttachmentCount = 1;
+    desc->colorFormats[0] = context->surfaceFormat.format;
+    desc->blendAttachments[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | 
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    desc->blendAttachments[0].blendEnable = VK_FALSE;
+
+    desc->dynamicStateCount = 2;
+    desc->dynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+    desc->dynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
+}
+
+void add_vulkan_pipeline_shader(MyPipelineDesc *desc, VkShaderStageFlagBits stage, const char *name)
+{
+    SDL_assert(desc->shaderCount < PIPELINE_MAX_SHADER_STAGES);
+    SDL_assert(strlen(name) < PIPELINE_SHADER_NAME_SIZE);
+
+    // strncpy zero fills the rest of the name
+    strncpy(desc->shaders[desc->shaderCount].name, name, PIPELINE_SHADER_NAME_SIZE - 1);
+    desc->shaders[desc->shaderCount].stage = stage;
+    desc->shaderCount++;
+}
+
+void add_vulkan_pipeline_shader_variant(const MyRenderContext *context, MyPipelineDesc *desc, VkShaderStageFlagBits stage,
+    const char *name)
+{
+    add_vulkan_pipeline_shader(desc, stage, select_vulkan_shader_variant(context->supportedFeatures.shaderVariantFeatures, name));
+}
+
+void add_vulkan_pipeline_push_constants(MyPipelineDesc *desc, VkShaderStageFlags stages, uint32_t offset, uint32_t size)
+{
+    VkPushConstantRange *range;
+
+    SDL_assert(desc->layout.pushConstantRangeCount < PIPELINE_MAX_PUSH_CONSTANT_RANGES);
+
+    range = &desc->layout.pushConstantRanges[desc->layout.pushConstantRangeCount++];
+    range->stageFlags = stages;
+    range->offset = offset;
+    range->size = size;
+}
+
+// Bindings stay sorted so equal sets compare equal as raw bytes
+static int add_pipeline_layout_binding(MyDescriptorSetLayoutDesc *set, const MyDescriptorBindingDesc *binding)
+{
+    uint32_t i = 0;
+
+    while (i < set->bindingCount && set->bindings[i].binding < binding->binding)
+    {
+        i++;
+    }
+
+    if (i < set->bindingCount && set->bindings[i].binding == binding->binding)
+    {
+        if (set->bindings[i].type != binding->type)
+        {
+            fprintf(stderr, "Binding %u is declared with descriptor types %d and %d\n", binding->binding, 
+                set->bindings[i].type, binding->type);
+            return VK_FALSE;
+        }
+
+        set->bindings[i].count = binding->count > set->bindings[i].count ? binding->count : set->bindings[i].count;
+        set->bindings[i].stages |= binding->stages;
+        return VK_TRUE;
+    }
+
+    if (set->bindingCount == PIPELINE_MAX_SET_BINDINGS)
+    {
+        fprintf(stderr, "More than %u bindings in a descriptor set\n", PIPELINE_MAX_SET_BINDINGS);
+        return VK_FALSE;
+    }
+
+    memmove(&set->bindings[i + 1], &set->bindings[i], sizeof(MyDescriptorBindingDesc) * (set->bindingCount - i));
+    set->bindings[i] = *binding;
+    set->bindingCount++;
+    return VK_TRUE;
+}
+
+int merge_vulkan_pipeline_layouts(MyPipelineLayoutDesc *dst, const MyPipelineLayoutDesc *src)
+{
+    VkPushConstantRange range = {0};
+    uint32_t end = 0;
+
+    for (uint32_t set = 0; set < src->setCount; set++)
+    {
+        for (uint32_t i = 0; i < src->sets[set].bindingCount; i++)
+        {
+            if (!add_pipeline_layout_binding(&dst->sets[set], &src->sets[set].bindings[i]))
+            {
+                return VK_FALSE;
+            }
+        }
+    }
+
+    dst->setCount = src->setCount > dst->setCount ? src->setCount : dst->setCount;
+
+    // A single range visible to all the stages, one vkCmdPushConstants call updates the block of every stage
+    range.offset = UINT32_MAX;
+    for (uint32_t i = 0; i < dst->pushConstantRangeCount + src->pushConstantRangeCount; i++)
+    {
+        const VkPushConstantRange *merged = i < dst->pushConstantRangeCount ? &dst->pushConstantRanges[i] :
+            &src->pushConstantRanges[i - dst->pushConstantRangeCount];
+
+        range.stageFlags |= merged->stageFlags;
+        range.offset = merged->offset < range.offset ? merged->offset : range.offset;
+        end = merged->offset + merged->size > end ? merged->offset + merged->size : end;
+    }
+
+    memset(dst->pushConstantRanges, 0, sizeof(dst->pushConstantRanges));
+    dst->pushConstantRangeCount = 0;
+    if (range.stageFlags)
+    {
+        range.size = end - range.offset;
+        dst->pushConstantRanges[dst->pushConstantRangeCount++] = range;
+    }
+
+    return VK_TRUE;
+}
+
+static int get_shader_pipeline_layout(const char *name, const MyShaderReflection *reflection, MyPipelineLayoutDesc *layout)
+{
+    MyDescriptorBindingDesc binding;
+
+    memset(layout, 0, sizeof(MyPipelineLayoutDesc));
+    for (uint32_t i = 0; i < reflection->bindingCount; i++)
+    {
+        if (reflection->bindings[i].set >= PIPELINE_MAX_DESCRIPTOR_SETS)
+        {
+            fprintf(stderr, "Shader %s uses descriptor set %u, the limit is %u sets\n", name, reflection->bindings[i].set,
+                PIPELINE_MAX_DESCRIPTOR_SETS);
+            return VK_FALSE;
+        }
+
+        binding.binding = reflection->bindings[i].binding;
+        binding.type = reflection->bindings[i].type;
+        binding.count = reflection->bindings[i].count;
+        binding.stages = reflection->stage;
+        if (!add_pipeline_layout_binding(&layout->sets[reflection->bindings[i].set], &binding))
+        {
+            return VK_FALSE;
+        }
+
+        if (reflection->bindings[i].set >= layout->setCount)
+        {
+            layout->setCount = reflection->bindings[i].set + 1;
+        }
+    }
+
+    if (reflection->pushConstantSize > 0)
+    {
+        layout->pushConstantRanges[0].stageFlags = reflection->stage;
+        layout->pushConstantRanges[0].offset = reflection->pushConstantOffset;
+        layout->pushConstantRanges[0].size = reflection->pushConstantSize;
+        layout->pushConstantRangeCount = 1;
+    }
+
+    return VK_TRUE;
+}
+
+static void check_pipeline_vertex_inputs(const MyPipelineDesc *desc, const char *name, const MyShaderReflection *reflection)
+{
+    uint32_t j;
+
+    // Fewer components than the shader reads are valid, the missing ones default to 0, 0, 1
+    for (uint32_t i = 0; i < reflection->vertexInputCount; i++)
+    {
+        for (j = 0; j < desc->vertexAttributeCount; j++)
+        {
+            if (desc->vertexAttributes[j].location == reflection->vertexInputs[i].location)
+            {
+                break;
+            }
+        }
+
+        if (j == desc->vertexAttributeCount)
+        {
+            fprintf(stderr, "Shader %s reads vertex input location %u, the pipeline has no attribute for it\n", name,
+                reflection->vertexInputs[i].location);
+        }
+    }
+}
+
+void reflect_vulkan_pipeline_layout(MyPipelineDesc *desc)
+{
+    MyShaderReflection reflection;
+    MyPipelineLayoutDesc shaderLayout;
+    const char *name;
+
+    memset(&desc->layout, 0, sizeof(MyPipelineLayoutDesc));
+    for (uint32_t i = 0; i < desc->shaderCount; i++)
+    {
+        name = desc->shaders[i].name;
+        if (!reflect_vulkan_shader(name, &reflection))
+        {
+            fprintf(stderr, "Failed to reflect shader %s\n", name);
+            exit(1);
+        }
+
+        if (reflection.stage != desc->shaders[i].stage)
+        {
+            fprintf(stderr, "Shader %s has stage 0x%x, the pipeline uses it as stage 0x%x\n", name, reflection.stage,
+                desc->shaders[i].stage);
+            exit(1);
+        }
+
+        if (!get_shader_pipeline_layout(name, &reflection, &shaderLayout) || !merge_vulkan_pipeline_layouts(&desc->layout,
+            &shaderLayout))
+        {
+            fprintf(stderr, "Shader %s is not compatible with the other shaders of the pipeline\n", name);
+            exit(1);
+        }
+
+        if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT)
+        {
+            check_pipeline_vertex_inputs(desc, name, &reflection);
+        }
+    }
+}
+
+static uint8_t has_dynamic_state(const MyPipelineDesc *desc, VkDynamicState state)
+{
+    for (uint32_t i = 0; i < desc->dynamicStateCount; i++)
+    {
+        if (desc->dynamicStates[i] == state)
+        {
+            return VK_TRUE;
+        }
+    }
+
+    return VK_FALSE;
+}
+
+static void add_dynamic_state(MyPipelineDesc *desc, VkDynamicState state)
+{
+    SDL_assert(desc->dynamicStateCount < PIPELINE_MAX_DYNAMIC_STATES);
+
+    if (!has_dynamic_state(desc, state))
+    {
+        desc->dynamicStates[desc->dynamicStateCount++] = state;
+    }
+}
+
+void add_vulkan_pipeline_dynamic_states(const MyRenderContext *context, MyPipelineDesc *desc)
+{
+    // Extended dynamic state 1
+    add_dynamic_state(desc, VK_DYNAMIC_STATE_CULL_MODE);
+    add_dynamic_state(desc, VK_DYNAMIC_STATE_FRONT_FACE);
+    add_dynamic_state(desc, VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY);
+
+    if (context->supportedFeatures.extendedDynamicState3Support)
+    {
+        add_dynamic_state(desc, VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+        add_dynamic_state(desc, VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+        add_dynamic_state(desc, VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT);
+        add_dynamic_state(desc, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT);
+    }
+}
+
+void set_vulkan_pipeline_dynamic_state(VkCommandBuffer commandBuffer, const MyPipelineDesc *desc)
+{
+    VkBool32 blendEnables[PIPELINE_MAX_COLOR_ATTACHMENTS];
+    VkColorBlendEquationEXT blendEquations[PIPELINE_MAX_COLOR_ATTACHMENTS];
+    VkColorComponentFlags writeMasks[PIPELINE_MAX_COLOR_ATTACHMENTS];
+
+    for (uint32_t i = 0; i < desc->colorAttachmentCount; i++)
+    {
+        blendEnables[i] = desc->blendAttachments[i].blendEnable;
+        blendEquations[i].srcColorBlendFactor = desc->blendAttachments[i].srcColorBlendFactor;
+        blendEquations[i].dstColorBlendFactor = desc->blendAttachments[i].dstColorBlendFactor;
+        blendEquations[i].colorBlendOp = desc->blendAttachments[i].colorBlendOp;
+        blendEquations[i].srcAlphaBlendFactor = desc->blendAttachments[i].srcAlphaBlendFactor;
+        blendEquations[i].dstAlphaBlendFactor = desc->blendAttachments[i].dstAlphaBlendFactor;
+        blendEquations[i].alphaBlendOp = desc->blendAttachments[i].alphaBlendOp;
+        writeMasks[i] = desc->blendAttachments[i].colorWriteMask;
+    }
+
+    for (uint32_t i = 0; i < desc->dynamicStateCount; i++)
+    {
+        switch (desc->dynamicStates[i])
+        {
+        case VK_DYNAMIC_STATE_CULL_MODE:
+            vkCmdSetCullMode(commandBuffer, desc->cullMode);
+            break;
+        case VK_DYNAMIC_STATE_FRONT_FACE:
+            vkCmdSetFrontFace(commandBuffer, desc->frontFace);
+            break;
+        case VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY:
+            vkCmdSetPrimitiveTopology(commandBuffer, desc->topology);
+            break;
+        case VK_DYNAMIC_STATE_POLYGON_MODE_EXT:
+            vkCmdSetPolygonModeEXT(commandBuffer, desc->polygonMode);
+            break;
+        case VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT:
+            vkCmdSetColorBlendEnableEXT(commandBuffer, 0, desc->colorAttachmentCount, blendEnables);
+            break;
+        case VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT:
+            vkCmdSetColorBlendEquationEXT(commandBuffer, 0, desc->colorAttachmentCount, blendEquations);
+            break;
+        case VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT:
+            vkCmdSetColorWriteMaskEXT(commandBuffer, 0, desc->colorAttachmentCount, writeMasks);
+            break;
+        default:
+            // viewport and scissor are set by the samples
+            break;
+        }
+    }
+}
+
+// Without dynamicPrimitiveTopologyUnrestricted the dynamic topology must be of the class of the pipeline topology
+static VkPrimitiveTopology get_topology_class(VkPrimitiveTopology topology)
+{
+    switch (topology)
+    {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+        return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+        return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+        return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+    default:
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    }
+}
+
+// Resets the state set in the command buffer to fixed values, it does not change the compiled pipeline
+static void get_pipeline_static_desc(const MyPipelineDesc *desc, MyPipelineDesc *key)
+{
+    memcpy(key, desc, sizeof(MyPipelineDesc));
+
+    if (has_dynamic_state(desc, VK_DYNAMIC_STATE_CULL_MODE))
+    {
+        key->cullMode = VK_CULL_MODE_NONE;
+    }
+
+    if (has_dynamic_state(desc, VK_DYNAMIC_STATE_FRONT_FACE))
+    {
+        key->frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    }
+
+    if (has_dynamic_state(desc, VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY))
+    {
+        key->topology = get_topology_class(desc->topology);
+    }
+
+    if (has_dynamic_state(desc, VK_DYNAMIC_STATE_POLYGON_MODE_EXT))
+    {
+        key->polygonMode = VK_POLYGON_MODE_FILL;
+    }
+
+    for (uint32_t i = 0; i < PIPELINE_MAX_COLOR_ATTACHMENTS; i++)
+    {
+        VkPipelineColorBlendAttachmentState *blend = &key->blendAttachments[i];
+
+        if (has_dynamic_state(desc, VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT))
+        {
+            blend->blendEnable = VK_FALSE;
+        }
+
+        if (has_dynamic_state(desc, VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT))
+        {
+            blend->srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+            blend->dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+            blend->colorBlendOp = VK_BLEND_OP_ADD;
+            blend->srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+            blend->dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+            blend->alphaBlendOp = VK_BLEND_OP_ADD;
+        }
+
+        if (has_dynamic_state(desc, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT))
+        {
+            blend->colorWriteMask = 0;
+        }
+    }
+}
+
+uint64_t hash_vulkan_pipeline_desc(const MyPipelineDesc *desc)
+{
+    const uint8_t *bytes = (const uint8_t *)desc;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    // FNV-1a over the whole state
+    for (size_t i = 0; i < sizeof(MyPipelineDesc); i++)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// Every binding and push constant range of the request is in the layout with at least the same stages and count
+static uint8_t covers_pipeline_layout(const MyPipelineLayoutDesc *layout, const MyPipelineLayoutDesc *request)
+{
+    const MyDescriptorBindingDesc *binding, *covering;
+    uint32_t j;
+
+    // vkCmdPushConstants takes the stages of the ranges, they must be the same
+    if (layout->pushConstantRangeCount != request->pushConstantRangeCount || memcmp(layout->pushConstantRanges,
+        request->pushConstantRanges, sizeof(VkPushConstantRange) * request->pushConstantRangeCount) != 0 ||
+        layout->setCount < request->setCount)
+    {
+        return VK_FALSE;
+    }
+
+    for (uint32_t set = 0; set < request->setCount; set++)
+    {
+        for (uint32_t i = 0; i < request->sets[set].bindingCount; i++)
+        {
+            binding = &request->sets[set].bindings[i];
+            for (j = 0; j < layout->sets[set].bindingCount; j++)
+            {
+                if (layout->sets[set].bindings[j].binding == binding->binding)
+                {
+                    break;
+                }
+            }
+
+            if (j == layout->sets[set].bindingCount)
+            {
+                return VK_FALSE;
+            }
+
+            covering = &layout->sets[set].bindings[j];
+            if (covering->type != binding->type || covering->count < binding->count ||
+                (covering->stages & binding->stages) != binding->stages)
+            {
+                return VK_FALSE;
+            }
+        }
+    }
+
+    return VK_TRUE;
+}
+
+// Index of the first layout covering the description, pipelines sharing a layout keep their descriptor sets bound
+// when switching between them
+static uint32_t get_shared_pipeline_layout(MyRenderContext *context, const MyPipelineLayoutDesc *layoutDesc)
+{
+    VkResult r;
+    MyPipelineTable *table = &context->pipelineTable;
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {0};
+    VkDescriptorSetLayoutBinding bindings[PIPELINE_MAX_SET_BINDINGS] = {0};
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+    MySharedPipelineLayout *shared;
+
+    for (uint32_t i = 0; i < table->layoutCount; i++)
+    {
+        if (covers_pipeline_layout(&table->layouts[i].desc, layoutDesc))
+        {
+            return i;
+        }
+    }
+
+    table->layouts = realloc(table->layouts, sizeof(MySharedPipelineLayout) * (table->layoutCount + 1));
+    shared = &table->layouts[table->layoutCount];
+    memset(shared, 0, sizeof(MySharedPipelineLayout));
+    memcpy(&shared->desc, layoutDesc, sizeof(MyPipelineLayoutDesc));
+
+    // Sets without bindings in between the used ones get an empty layout
+    for (uint32_t set = 0; set < layoutDesc->setCount; set++)
+    {
+        for (uint32_t i = 0; i < layoutDesc->sets[set].bindingCount; i++)
+        {
+            bindings[i].binding = layoutDesc->sets[set].bindings[i].binding;
+            bindings[i].descriptorType = layoutDesc->sets[set].bindings[i].type;
+            bindings[i].descriptorCount = layoutDesc->sets[set].bindings[i].count;
+            bindings[i].stageFlags = layoutDesc->sets[set].bindings[i].stages;
+        }
+
+        setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        setLayoutInfo.bindingCount = layoutDesc->sets[set].bindingCount;
+        setLayoutInfo.pBindings = bindings;
+        CHECK_VK(vkCreateDescriptorSetLayout(context->logicalDevice, &setLayoutInfo, context->allocationCallbacks,
+            &shared->setLayouts[set]));
+    }
+
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = layoutDesc->setCount;
+    pipelineLayoutInfo.pSetLayouts = shared->setLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = layoutDesc->pushConstantRangeCount;
+    pipelineLayoutInfo.pPushConstantRanges = layoutDesc->pushConstantRanges;
+
+    CHECK_VK(vkCreatePipelineLayout(context->logicalDevice, &pipelineLayoutInfo, context->allocationCallbacks, &shared->layout));
+    return table->layoutCount++;
+}
+
+uint32_t get_vulkan_descriptor_set_layouts(MyRenderContext *context, const MyPipelineLayoutDesc *layoutDesc,
+    VkDescriptorSetLayout *setLayouts)
+{
+    // The table grows when the layout is created, the pointer is taken after
+    uint32_t layoutIndex = get_shared_pipeline_layout(context, layoutDesc);
+    MySharedPipelineLayout *shared = &context->pipelineTable.layouts[layoutIndex];
+
+    memcpy(setLayouts, shared->setLayouts, sizeof(VkDescriptorSetLayout) * shared->desc.setCount);
+    return shared->desc.setCount;
+}
+
+// Runs on a pipeline builder worker, the entry description and layout do not change after the submit.
+// libraryParts are set to compile a graphics pipeline library instead of a complete pipeline.
+// Returns VK_NULL_HANDLE if a shader or the pipeline fails to compile.
+static VkPipeline compile_vulkan_pipeline(MyRenderContext *context, const MyPipelineDesc *desc, VkPipelineLayout layout,
+    VkGraphicsPipelineLibraryFlagsEXT libraryParts)
+{
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    uint32_t moduleCount = 0;
+    VkPipelineShaderStageCreateInfo shaderStages[PIPELINE_MAX_SHADER_STAGES] = {0};
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {0};
+    VkPipelineViewportStateCreateInfo viewportStateInfo = {0};
+    VkPipelineRasterizationStateCreateInfo rasterizerInfo = {0};
+    VkPipelineMultisampleStateCreateInfo multisamplingInfo = {0};
+    VkPipelineColorBlendStateCreateInfo colorBlendingInfo = {0};
+    VkPipelineDynamicStateCreateInfo dynamicStateInfo = {0};
+    VkPipelineRenderingCreateInfo pipelineRenderingCreateInfo = {0};
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo = {0};
+    VkGraphicsPipelineCreateInfo pipelineInfo = {0};
+
+    for (; moduleCount < desc->shaderCount; moduleCount++)
+    {
+        shaderStages[moduleCount].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[moduleCount].stage = desc->shaders[moduleCount].stage;
+        shaderStages[moduleCount].pName = "main"; // Entry point name
+
+        if (!try_get_vulkan_shader_module(context->logicalDevice, context->allocationCallbacks, desc->shaders[moduleCount].name,
+            &shaderStages[moduleCount].module))
+        {
+            break;
+        }
+    }
+
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = desc->vertexBindingCount;
+    vertexInputInfo.pVertexBindingDescriptions = desc->vertexBindings;
+    vertexInputInfo.vertexAttributeDescriptionCount = desc->vertexAttributeCount;
+    vertexInputInfo.pVertexAttributeDescriptions = desc->vertexAttributes;
+
+    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyInfo.topology = desc->topology;
+    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+    viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateInfo.viewportCount = 1;
+    viewportStateInfo.scissorCount = 1;
+
+    rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizerInfo.depthClampEnable = VK_FALSE;
+    rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
+    rasterizerInfo.polygonMode = desc->polygonMode;
+    rasterizerInfo.lineWidth = 1.0f;
+    rasterizerInfo.cullMode = desc->cullMode;
+    rasterizerInfo.frontFace = desc->frontFace;
+    rasterizerInfo.depthBiasEnable = VK_FALSE;
+
+    multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisamplingInfo.sampleShadingEnable = VK_FALSE;
+    multisamplingInfo.rasterizationSamples = desc->samples;
+
+    colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendingInfo.logicOpEnable = VK_FALSE;
+    colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
+    colorBlendingInfo.attachmentCount = desc->colorAttachmentCount;
+    colorBlendingInfo.pAttachments = desc->blendAttachments;
+
+    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateInfo.dynamicStateCount = desc->dynamicStateCount;
+    dynamicStateInfo.pDynamicStates = desc->dynamicStates;
+
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = desc->shaderCount;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+    pipelineInfo.pViewportState = &viewportStateInfo;
+    pipelineInfo.pRasterizationState = &rasterizerInfo;
+    pipelineInfo.pMultisampleState = &multisamplingInfo;
+    pipelineInfo.pColorBlendState = &colorBlendingInfo;
+    pipelineInfo.pDynamicState = &dynamicStateInfo;
+    pipelineInfo.layout = layout;
+    pipelineInfo.renderPass = desc->renderPass;
+    pipelineInfo.subpass = desc->subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    // Dynamic rendering, attachment formats instead of a render pass
+    if (!desc->renderPass)
+    {
+        pipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        pipelineRenderingCreateInfo.colorAttachmentCount = desc->colorAttachmentCount;
+        pipelineRenderingCreateInfo.pColorAttachmentFormats = desc->colorFormats;
+        pipelineInfo.pNext = &pipelineRenderingCreateInfo;
+    }
+
+    // State of the other parts is ignored, libraries keep the information needed for an optimized link
+    if (libraryParts)
+    {
+        libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+        libraryInfo.pNext = pipelineInfo.pNext;
+        libraryInfo.flags = libraryParts;
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    }
+
+    if (moduleCount == desc->shaderCount && vkCreateGraphicsPipelines(context->logicalDevice, context->pipelineCache, 1,
+        &pipelineInfo, context->allocationCallbacks, &pipeline) != VK_SUCCESS)
+    {
+        pipeline = VK_NULL_HANDLE;
+    }
+
+    for (uint32_t i = 0; i < moduleCount; i++)
+    {
+        vkDestroyShaderModule(context->logicalDevice, shaderStages[i].module, context->allocationCallbacks);
+    }
+
+    return pipeline;
+}
+
+static VkPipeline build_vulkan_pipeline(MyRenderContext *context, void *userData)
+{
+    const MyPipelineEntry *entry = userData;
+    VkPipeline pipeline = compile_vulkan_pipeline(context, &entry->desc, entry->layout, 0);
+
+    if (!pipeline)
+    {
+        fprintf(stderr, "Failed to create the graphics pipeline\n");
+        exit(1);
+    }
+
+    return pipeline;
+}
+
+// Failed rebuilds keep the current pipeline, the next shader change tries again
+static VkPipeline rebuild_vulkan_pipeline(MyRenderContext *context, void *userData)
+{
+    const MyPipelineEntry *entry = userData;
+
+    return compile_vulkan_pipeline(context, &entry->desc, entry->layout, 0);
+}
+
+static VkPipeline link_vulkan_pipeline(MyRenderContext *context, const MyPipelineEntry *entry, VkPipelineCreateFlags flags)
+{
+    VkPipelineLibraryCreateInfoKHR libraryInfo = {0};
+    VkGraphicsPipelineCreateInfo pipelineInfo = {0};
+    VkPipeline pipeline;
+
+    libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    libraryInfo.libraryCount = PIPELINE_LIBRARY_PART_COUNT;
+    libraryInfo.pLibraries = entry->libraries;
+
+    // All the state comes from the libraries
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags = flags;
+    pipelineInfo.layout = entry->layout;
+
+    if (vkCreateGraphicsPipelines(context->logicalDevice, context->pipelineCache, 1, &pipelineInfo, context->allocationCallbacks,
+        &pipeline) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    return pipeline;
+}
+
+// Background replacement of a fast linked pipeline, as fast to execute as a monolithic one
+static VkPipeline optimize_vulkan_pipeline(MyRenderContext *context, void *userData)
+{
+    return link_vulkan_pipeline(context, userData, VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT);
+}
+
+static void get_pipeline_library_key(const MyPipelineDesc *desc, VkGraphicsPipelineLibraryFlagsEXT part, MyPipelineDesc *key)
+{
+    // Same zero padding as init_vulkan_pipeline_desc, dynamic states may belong to any of the parts
+    memset(key, 0, sizeof(MyPipelineDesc));
+    memcpy(key->dynamicStates, desc->dynamicStates, sizeof(desc->dynamicStates));
+    key->dynamicStateCount = desc->dynamicStateCount;
+
+    if (part == VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT)
+    {
+        memcpy(key->vertexBindings, desc->vertexBindings, sizeof(desc->vertexBindings));
+        memcpy(key->vertexAttributes, desc->vertexAttributes, sizeof(desc->vertexAttributes));
+        key->vertexBindingCount = desc->vertexBindingCount;
+        key->vertexAttributeCount = desc->vertexAttributeCount;
+        key->topology = desc->topology;
+        return;
+    }
+
+    key->renderPass = desc->renderPass;
+    key->subpass = desc->subpass;
+
+    if (part == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT)
+    {
+        memcpy(key->colorFormats, desc->colorFormats, sizeof(desc->colorFormats));
+        memcpy(key->blendAttachments, desc->blendAttachments, sizeof(desc->blendAttachments));
+        key->colorAttachmentCount = desc->colorAttachmentCount;
+        key->samples = desc->samples;
+        return;
+    }
+
+    // Shader parts, both are compiled with the same pipeline layout
+    memcpy(&key->layout, &desc->layout, sizeof(MyPipelineLayoutDesc));
+    for (uint32_t i = 0; i < desc->shaderCount; i++)
+    {
+        if ((desc->shaders[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT) == (part == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT))
+        {
+            memcpy(&key->shaders[key->shaderCount++], &desc->shaders[i], sizeof(MyPipelineShader));
+        }
+    }
+
+    if (part == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT)
+    {
+        key->polygonMode = desc->polygonMode;
+        key->cullMode = desc->cullMode;
+        key->frontFace = desc->frontFace;
+    }
+    else
+    {
+        key->samples = desc->samples;
+    }
+}
+
+// Runs on a pipeline builder worker, the library key and layout do not change after the submit
+static VkPipeline build_vulkan_pipeline_library(MyRenderContext *context, void *userData)
+{
+    const MyPipelineLibrary *library = userData;
+
+    return compile_vulkan_pipeline(context, &library->key, library->layout, library->part);
+}
+
+// Libraries are shared by all the pipelines with the same state of the part, only new parts are compiled,
+// in the background like the complete pipelines
+static MyPipelineLibrary *get_vulkan_pipeline_library(MyRenderContext *context, const MyPipelineDesc *desc,
+    VkPipelineLayout layout, VkGraphicsPipelineLibraryFlagsEXT part)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+    MyPipelineLibrary *library;
+    MyPipelineDesc key;
+    uint64_t hash;
+
+    get_pipeline_library_key(desc, part, &key);
+    hash = hash_vulkan_pipeline_desc(&key);
+
+    for (uint32_t i = 0; i < table->libraryCount; i++)
+    {
+        library = table->libraries[i];
+        if (library->hash == hash && library->part == part && memcmp(&library->key, &key, sizeof(MyPipelineDesc)) == 0)
+        {
+            return library;
+        }
+    }
+
+    if (table->libraryCount == table->libraryCapacity)
+    {
+        table->libraryCapacity = table->libraryCapacity ? table->libraryCapacity * 2 : PIPELINE_TABLE_INITIAL_SIZE;
+        table->libraries = realloc(table->libraries, sizeof(MyPipelineLibrary *) * table->libraryCapacity);
+    }
+
+    library = calloc(1, sizeof(MyPipelineLibrary));
+    library->hash = hash;
+    library->part = part;
+    memcpy(&library->key, &key, sizeof(MyPipelineDesc));
+    library->layout = layout;
+    library->buildHandle = submit_vulkan_pipeline_build(context, build_vulkan_pipeline_library, library);
+    library->pending = VK_TRUE;
+    table->libraries[table->libraryCount++] = library;
+    return library;
+}
+
+// Returns VK_FALSE if the library is still compiling and block is not set
+static uint8_t collect_vulkan_pipeline_library(MyRenderContext *context, MyPipelineLibrary *library, uint8_t block)
+{
+    if (!library->pending)
+    {
+        return VK_TRUE;
+    }
+
+    if (block)
+    {
+        library->library = wait_vulkan_pipeline_build(context, library->buildHandle);
+    }
+    else if (!poll_vulkan_pipeline_build(context, library->buildHandle, &library->library))
+    {
+        return VK_FALSE;
+    }
+
+    library->pending = VK_FALSE;
+    return VK_TRUE;
+}
+
+// Links the entry once its libraries are collected, a part that failed to compile falls back to a complete build.
+// Returns VK_FALSE if a library is still compiling and block is not set.
+static uint8_t finish_vulkan_pipeline_link(MyRenderContext *context, MyPipelineEntry *entry, uint8_t block)
+{
+    uint8_t linked = VK_TRUE;
+
+    for (uint32_t i = 0; i < PIPELINE_LIBRARY_PART_COUNT; i++)
+    {
+        if (!collect_vulkan_pipeline_library(context, entry->linkLibraries[i], block))
+        {
+            return VK_FALSE;
+        }
+    }
+
+    for (uint32_t i = 0; i < PIPELINE_LIBRARY_PART_COUNT; i++)
+    {
+        entry->libraries[i] = entry->linkLibraries[i]->library;
+        entry->linkLibraries[i] = NULL;
+        linked &= entry->libraries[i] != VK_NULL_HANDLE;
+    }
+
+    entry->linkPending = VK_FALSE;
+    context->pipelineTable.pendingLinkCount--;
+
+    if (!linked || (entry->pipeline = link_vulkan_pipeline(context, entry, 0)) == VK_NULL_HANDLE)
+    {
+        entry->buildHandle = submit_vulkan_pipeline_build(context, build_vulkan_pipeline, entry);
+        return VK_TRUE;
+    }
+
+    context->pipelineTable.linkCount++;
+    entry->reloadHandle = submit_vulkan_pipeline_build(context, optimize_vulkan_pipeline, entry);
+    entry->reloadPending = VK_TRUE;
+    entry->optimizing = VK_TRUE;
+    return VK_TRUE;
+}
+
+// Only links right away if every part is already built, new parts are compiled by the pipeline builder and
+// the entry is linked when they are collected
+static void fast_link_vulkan_pipeline(MyRenderContext *context, MyPipelineEntry *entry)
+{
+    static const VkGraphicsPipelineLibraryFlagsEXT parts[PIPELINE_LIBRARY_PART_COUNT] = {
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+    };
+
+    for (uint32_t i = 0; i < PIPELINE_LIBRARY_PART_COUNT; i++)
+    {
+        entry->linkLibraries[i] = get_vulkan_pipeline_library(context, &entry->desc, entry->layout, parts[i]);
+    }
+
+    entry->linkPending = VK_TRUE;
+    context->pipelineTable.pendingLinkCount++;
+    finish_vulkan_pipeline_link(context, entry, VK_FALSE);
+}
+
+// Non blocking, collects the finished build or link of the entry. Returns VK_TRUE once the pipeline is usable.
+static uint8_t poll_vulkan_pipeline_entry(MyRenderContext *context, MyPipelineEntry *entry)
+{
+    if (entry->linkPending)
+    {
+        finish_vulkan_pipeline_link(context, entry, VK_FALSE);
+    }
+
+    if (!entry->pipeline && !entry->linkPending)
+    {
+        poll_vulkan_pipeline_build(context, entry->buildHandle, &entry->pipeline);
+    }
+
+    return entry->pipeline != VK_NULL_HANDLE;
+}
+
+static void destroy_vulkan_pipeline_library(MyRenderContext *context, MyPipelineLibrary *library)
+{
+    collect_vulkan_pipeline_library(context, library, VK_TRUE);
+    vkDestroyPipeline(context->logicalDevice, library->library, context->allocationCallbacks);
+    free(library);
+}
+
+static void insert_pipeline_bucket(MyPipelineTable *table, uint32_t entryIndex)
+{
+    uint32_t bucket = (uint32_t)table->entries[entryIndex]->hash & (table->bucketCount - 1);
+
+    // Linear probing, the table is kept at most half full
+    while (table->buckets[bucket])
+    {
+        bucket = (bucket + 1) & (table->bucketCount - 1);
+    }
+
+    table->buckets[bucket] = entryIndex + 1;
+}
+
+static void grow_pipeline_table(MyPipelineTable *table)
+{
+    free(table->buckets);
+    table->bucketCount *= 2;
+    table->buckets = calloc(table->bucketCount, sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < table->entryCount; i++)
+    {
+        insert_pipeline_bucket(table, i);
+    }
+}
+
+void create_vulkan_pipeline_table(MyRenderContext *context)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+
+    memset(table, 0, sizeof(MyPipelineTable));
+    table->bucketCount = PIPELINE_TABLE_INITIAL_SIZE;
+    table->buckets = calloc(table->bucketCount, sizeof(uint32_t));
+}
+
+void destroy_vulkan_pipeline_table(MyRenderContext *context)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+
+    for (uint32_t i = 0; i < table->entryCount; i++)
+    {
+        // Collect the builds nobody waited for
+        get_vulkan_pipeline(context, i);
+        vkDestroyPipeline(context->logicalDevice, table->entries[i]->pipeline, context->allocationCallbacks);
+
+        if (table->entries[i]->reloadPending)
+        {
+            vkDestroyPipeline(context->logicalDevice, wait_vulkan_pipeline_build(context, table->entries[i]->reloadHandle),
+                context->allocationCallbacks);
+        }
+
+        free(table->entries[i]);
+    }
+
+    for (uint32_t i = 0; i < table->libraryCount; i++)
+    {
+        destroy_vulkan_pipeline_library(context, table->libraries[i]);
+    }
+
+    for (uint32_t i = 0; i < table->staleLibraryCount; i++)
+    {
+        destroy_vulkan_pipeline_library(context, table->staleLibraries[i]);
+    }
+
+    for (uint32_t i = 0; i < table->layoutCount; i++)
+    {
+        vkDestroyPipelineLayout(context->logicalDevice, table->layouts[i].layout, context->allocationCallbacks);
+        for (uint32_t set = 0; set < table->layouts[i].desc.setCount; set++)
+        {
+            vkDestroyDescriptorSetLayout(context->logicalDevice, table->layouts[i].setLayouts[set], context->allocationCallbacks);
+        }
+    }
+
+    free(table->entries);
+    free(table->buckets);
+    free(table->layouts);
+    free(table->libraries);
+    free(table->staleLibraries);
+    memset(table, 0, sizeof(MyPipelineTable));
+}
+
+MyPipelineId request_vulkan_pipeline(MyRenderContext *context, const MyPipelineDesc *state)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+    MyPipelineEntry *entry;
+    MyPipelineDesc staticDesc;
+    const MyPipelineDesc *desc = &staticDesc;
+    uint64_t hash;
+    uint32_t bucket;
+    uint32_t entryIndex;
+    uint32_t layoutIndex;
+
+    get_pipeline_static_desc(state, &staticDesc);
+    hash = hash_vulkan_pipeline_desc(desc);
+    bucket = (uint32_t)hash & (table->bucketCount - 1);
+    table->requestCount++;
+
+    for (; table->buckets[bucket]; bucket = (bucket + 1) & (table->bucketCount - 1))
+    {
+        entry = table->entries[table->buckets[bucket] - 1];
+        if (entry->hash == hash && memcmp(&entry->desc, desc, sizeof(MyPipelineDesc)) == 0)
+        {
+            return table->buckets[bucket] - 1;
+        }
+    }
+
+    if (table->entryCount == table->entryCapacity)
+    {
+        table->entryCapacity = table->entryCapacity ? table->entryCapacity * 2 : PIPELINE_TABLE_INITIAL_SIZE;
+        table->entries = realloc(table->entries, sizeof(MyPipelineEntry *) * table->entryCapacity);
+    }
+
+    entry = calloc(1, sizeof(MyPipelineEntry));
+    entry->hash = hash;
+    memcpy(&entry->desc, desc, sizeof(MyPipelineDesc));
+    layoutIndex = get_shared_pipeline_layout(context, &desc->layout);
+    entry->layout = table->layouts[layoutIndex].layout;
+
+    entryIndex = table->entryCount++;
+    table->entries[entryIndex] = entry;
+
+    if (table->entryCount * 2 > table->bucketCount)
+    {
+        grow_pipeline_table(table);
+    }
+    else
+    {
+        insert_pipeline_bucket(table, entryIndex);
+    }
+
+    // Linking the cached libraries takes a fraction of a full compile, with all of them built the pipeline is usable
+    // right away
+    if (context->supportedFeatures.graphicsPipelineLibrarySupport)
+    {
+        fast_link_vulkan_pipeline(context, entry);
+    }
+    else
+    {
+        entry->buildHandle = submit_vulkan_pipeline_build(context, build_vulkan_pipeline, entry);
+    }
+
+    return entryIndex;
+}
+
+VkPipeline get_vulkan_pipeline(MyRenderContext *context, MyPipelineId id)
+{
+    MyPipelineEntry *entry = context->pipelineTable.entries[id];
+
+    if (entry->linkPending)
+    {
+        finish_vulkan_pipeline_link(context, entry, VK_TRUE);
+    }
+
+    if (!entry->pipeline)
+    {
+        entry->pipeline = wait_vulkan_pipeline_build(context, entry->buildHandle);
+    }
+
+    return entry->pipeline;
+}
+
+VkPipelineLayout get_vulkan_pipeline_layout(MyRenderContext *context, MyPipelineId id)
+{
+    return context->pipelineTable.entries[id]->layout;
+}
+
+void reload_vulkan_pipelines(MyRenderContext *context, const char *shaderName)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+    MyPipelineEntry *entry;
+
+    for (uint32_t i = 0; i < table->entryCount; i++)
+    {
+        entry = table->entries[i];
+        for (uint32_t j = 0; j < entry->desc.shaderCount; j++)
+        {
+            if (strcmp(entry->desc.shaders[j].name, shaderName) != 0)
+            {
+                continue;
+            }
+
+            // A first build may have read the old shader too, the entry is rebuilt once it is collected
+            if (entry->reloadPending || !entry->pipeline)
+            {
+                entry->reloadDirty = VK_TRUE;
+            }
+            else
+            {
+                entry->reloadHandle = submit_vulkan_pipeline_build(context, rebuild_vulkan_pipeline, entry);
+                entry->reloadPending = VK_TRUE;
+            }
+
+            break;
+        }
+    }
+
+    // New permutations must not link the old shader code
+    for (uint32_t i = 0; i < table->libraryCount;)
+    {
+        const MyPipelineDesc *key = &table->libraries[i]->key;
+        uint8_t stale = VK_FALSE;
+
+        for (uint32_t j = 0; j < key->shaderCount; j++)
+        {
+            stale |= strcmp(key->shaders[j].name, shaderName) == 0;
+        }
+
+        if (!stale)
+        {
+            i++;
+            continue;
+        }
+
+        table->staleLibraries = realloc(table->staleLibraries, sizeof(MyPipelineLibrary *) * (table->staleLibraryCount + 1));
+        table->staleLibraries[table->staleLibraryCount++] = table->libraries[i];
+        table->libraries[i] = table->libraries[--table->libraryCount];
+    }
+}
+
+void update_vulkan_pipeline_reloads(MyRenderContext *context)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+    MyPipelineEntry *entry;
+    VkPipeline pipeline;
+    uint8_t optimizing = VK_FALSE;
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < table->entryCount; i++)
+    {
+        // Entries whose libraries were still compiling when they were requested
+        if (table->entries[i]->linkPending)
+        {
+            finish_vulkan_pipeline_link(context, table->entries[i], VK_FALSE);
+        }
+    }
+
+    // The last draw state switch may have requested a pipeline which was not built yet
+    if (table->drawStatePending && poll_vulkan_pipeline_entry(context, table->entries[table->drawStatePipeline]))
+    {
+        table->drawStatePending = VK_FALSE;
+        context->graphicsPipeline = table->entries[table->drawStatePipeline]->pipeline;
+        context->graphicsPipelineLayout = table->entries[table->drawStatePipeline]->layout;
+        printf("Switched to the pipeline of the new draw state\n");
+    }
+
+    for (uint32_t i = 0; i < table->entryCount; i++)
+    {
+        entry = table->entries[i];
+        // Shader changed during the first build. Collecting a fast link submits its optimized link, the rebuild then
+        // follows that one.
+        if (entry->reloadDirty && !entry->reloadPending && poll_vulkan_pipeline_entry(context, entry) && !entry->reloadPending)
+        {
+            entry->reloadDirty = VK_FALSE;
+            entry->reloadHandle = submit_vulkan_pipeline_build(context, rebuild_vulkan_pipeline, entry);
+            entry->reloadPending = VK_TRUE;
+        }
+
+        if (!entry->reloadPending)
+        {
+            continue;
+        }
+
+        if (!poll_vulkan_pipeline_build(context, entry->reloadHandle, &pipeline))
+        {
+            optimizing |= entry->optimizing;
+            continue;
+        }
+
+        entry->reloadPending = VK_FALSE;
+        if (pipeline)
+        {
+            // Frame boundary, the frames in flight may still execute the old pipeline
+            defer_vulkan_pipeline_destroy(context, entry->pipeline);
+            if (context->graphicsPipeline == entry->pipeline)
+            {
+                context->graphicsPipeline = pipeline;
+            }
+
+            entry->pipeline = pipeline;
+            if (!entry->optimizing)
+            {
+                printf("Reloaded pipeline %u\n", i);
+            }
+        }
+        else if (entry->optimizing)
+        {
+            // The fast linked pipeline stays, it is slower to execute but complete
+            fprintf(stderr, "Failed to optimize pipeline %u\n", i);
+        }
+        else
+        {
+            fprintf(stderr, "Failed to reload pipeline %u, keeping the previous one\n", i);
+        }
+
+        entry->optimizing = VK_FALSE;
+
+        if (entry->reloadDirty)
+        {
+            entry->reloadDirty = VK_FALSE;
+            entry->reloadHandle = submit_vulkan_pipeline_build(context, rebuild_vulkan_pipeline, entry);
+            entry->reloadPending = VK_TRUE;
+        }
+    }
+
+    // Running optimized links and the links waiting for their parts may still read the libraries of the changed shaders
+    for (uint32_t i = 0; i < table->staleLibraryCount; i++)
+    {
+        if (optimizing || table->pendingLinkCount > 0 || !collect_vulkan_pipeline_library(context, table->staleLibraries[i], VK_FALSE))
+        {
+            table->staleLibraries[kept++] = table->staleLibraries[i];
+            continue;
+        }
+
+        destroy_vulkan_pipeline_library(context, table->staleLibraries[i]);
+    }
+
+    table->staleLibraryCount = kept;
+}
+
+void print_vulkan_pipeline_table_stats(MyRenderContext *context)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+
+    printf("Pipelines: %u requested, %u created, %u fast linked from %u libraries, %u layouts\n", table->requestCount,
+        table->entryCount, table->linkCount, table->libraryCount, table->layoutCount);
+}
+
+// Never waits for a compile, the current pipeline is drawn with until update_vulkan_pipeline_reloads swaps in the new one
+static void select_vulkan_draw_state_pipeline(MyRenderContext *context)
+{
+    MyPipelineTable *table = &context->pipelineTable;
+    uint32_t entryCount = table->entryCount;
+    MyPipelineId pipelineId = request_vulkan_pipeline(context, &context->drawState);
+
+    table->drawStatePipeline = pipelineId;
+    table->drawStatePending = !poll_vulkan_pipeline_entry(context, table->entries[pipelineId]);
+    if (table->drawStatePending)
+    {
+        printf("Compiling a pipeline for the new state in the background\n");
+        return;
+    }
+
+    context->graphicsPipeline = table->entries[pipelineId]->pipeline;
+    context->graphicsPipelineLayout = table->entries[pipelineId]->layout;
+    printf("%s\n", table->entryCount != entryCount ? "Linked a pipeline for the new state" :
+        "No pipeline compiled, the state is dynamic or was used before");
+}
+
+void toggle_vulkan_wireframe(MyRenderContext *context)
+{
+    if (!context->supportedFeatures.features.fillModeNonSolid)
+    {
+        printf("Wireframe is not supported, fillModeNonSolid is not available\n");
+        return;
+    }
+
+    context->drawState.polygonMode = context->drawState.polygonMode == VK_POLYGON_MODE_FILL ? VK_POLYGON_MODE_LINE :
+        VK_POLYGON_MODE_FILL;
+    printf("Polygon mode %s: ", context->drawState.polygonMode == VK_POLYGON_MODE_FILL ? "fill" : "line");
+    select_vulkan_draw_state_pipeline(context);
+}
+
+void cycle_vulkan_cull_mode(MyRenderContext *context)
+{
+    static const char *cullModeNames[] = { "none", "front", "back", "front and back" };
+
+    context->drawState.cullMode = (context->drawState.cullMode + 1) % 4;
+    printf("Cull mode %s: ", cullModeNames[context->drawState.cullMode]);
+    select_vulkan_draw_state_pipeline(context);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "common.h"
+
+typedef uint32_t MyPipelineId;
+
+// Defaults: triangle list, filled, back face culling, counter clockwise front faces, no blending,
+// one color attachment of the surface format, dynamic viewport and scissor, no push constants
+void init_vulkan_pipeline_desc(const MyRenderContext *context, MyPipelineDesc *desc);
+void add_vulkan_pipeline_shader(MyPipelineDesc *desc, VkShaderStageFlagBits stage, const char *name);
+// Adds the cheapest variant of the shader the device supports, see select_vulkan_shader_variant
+void add_vulkan_pipeline_shader_variant(const MyRenderContext *context, MyPipelineDesc *desc, VkShaderStageFlagBits stage,
+    const char *name);
+void add_vulkan_pipeline_push_constants(MyPipelineDesc *desc, VkShaderStageFlags stages, uint32_t offset, uint32_t size);
+// Replaces the layout of the description with the descriptor bindings and push constants the shaders declare,
+// exits if a shader cannot be reflected or the shaders disagree. Call after the shaders and vertex input are added.
+void reflect_vulkan_pipeline_layout(MyPipelineDesc *desc);
+// Adds the bindings of src to dst, the push constant ranges of both become one range with the stages of all of them.
+// Returns VK_FALSE if a binding has different descriptor types.
+int merge_vulkan_pipeline_layouts(MyPipelineLayoutDesc *dst, const MyPipelineLayoutDesc *src);
+// Makes cull mode, front face, topology within its class (Vulkan 1.3), polygon mode and color blend
+// (VK_EXT_extended_dynamic_state3) dynamic, one pipeline then covers all the variants of this state
+void add_vulkan_pipeline_dynamic_states(const MyRenderContext *context, MyPipelineDesc *desc);
+// Sets the state of the description for each of its dynamic states, except viewport and scissor
+void set_vulkan_pipeline_dynamic_state(VkCommandBuffer commandBuffer, const MyPipelineDesc *desc);
+uint64_t hash_vulkan_pipeline_desc(const MyPipelineDesc *desc);
+
+// The table is used by the main thread only, pipelines are compiled by the pipeline builder.
+// A state requested again returns the id of the existing pipeline without compiling anything.
+void create_vulkan_pipeline_table(MyRenderContext *context);
+void destroy_vulkan_pipeline_table(MyRenderContext *context);
+// The dynamic state of the description is ignored, descriptions differing only by it share a pipeline.
+MyPipelineId request_vulkan_pipeline(MyRenderContext *context, const MyPipelineDesc *state);
+// Waits for the compile on the first call
+VkPipeline get_vulkan_pipeline(MyRenderContext *context, MyPipelineId id);
+VkPipelineLayout get_vulkan_pipeline_layout(MyRenderContext *context, MyPipelineId id);
+// Set layouts of the shared pipeline layout covering the description, returns the set count
+uint32_t get_vulkan_descriptor_set_layouts(MyRenderContext *context, const MyPipelineLayoutDesc *layoutDesc,
+    VkDescriptorSetLayout *setLayouts);
+void print_vulkan_pipeline_table_stats(MyRenderContext *context);
+// Queues a background rebuild of every pipeline using the shader, like "base.vert"
+void reload_vulkan_pipelines(MyRenderContext *context, const char *shaderName);
+// Called at a frame boundary after the frame fence wait, never blocks. Links the pipelines whose libraries
+// finished compiling, swaps in the finished rebuilds and destroys the replaced pipelines no frame in flight can use anymore.
+void update_vulkan_pipeline_reloads(MyRenderContext *context);
+// Draw state switches of the samples, change context->drawState and select the pipeline for it.
+// Nothing is compiled if the changed state is dynamic. A pipeline not built yet is compiled in the background
+// and swapped in by update_vulkan_pipeline_reloads, the previous one is drawn with meanwhile.
+void toggle_vulkan_wireframe(MyRenderContext *context);
+void cycle_vulkan_cull_mode(MyRenderContext *context);
@@ -0,0 +1,244 @@
+#include "record_workers.h"
+
+#include <string.h>
+
+#define DRAW_COUNT_ENV "VK_BEGINNER_DRAW_COUNT"
+
+static VkCommandBuffer get_record_command_buffer(MyRenderContext *context, MyRecordThread *thread, uint32_t frameInFlightIndex)
+{
+    VkResult r;
+    VkCommandBufferAllocateInfo commandBufferInfo = {0};
+    uint32_t index = thread->usedCount[frameInFlightIndex]++;
+
+    if (index == thread->commandBufferCount[frameInFlightIndex])
+    {
+        thread->commandBuffers[frameInFlightIndex] = realloc(thread->commandBuffers[frameInFlightIndex],
+            sizeof(VkCommandBuffer) * (index + 1));
+
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool = thread->commandPools[frameInFlightIndex];
+        commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        commandBufferInfo.commandBufferCount = 1;
+
+        CHECK_VK(vkAllocateCommandBuffers(context->logicalDevice, &commandBufferInfo, thread->commandBuffers[frameInFlightIndex] + index));
+        thread->commandBufferCount[frameInFlightIndex]++;
+    }
+
+    return thread->commandBuffers[frameInFlightIndex][index];
+}
+
+static void record_vulkan_job(MyRenderContext *context, MyRecordThread *thread, uint32_t job)
+{
+    VkResult r;
+    MyRecordWorkers *workers = &context->recordWorkers;
+    VkCommandBufferBeginInfo beginInfo = {0};
+    VkCommandBuffer commandBuffer = get_record_command_buffer(context, thread, workers->frameInFlightIndex);
+    uint32_t firstDraw = (uint32_t)((uint64_t)workers->drawCount * job / workers->jobCount);
+    uint32_t lastDraw = (uint32_t)((uint64_t)workers->drawCount * (job + 1) / workers->jobCount);
+
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = workers->inheritance;
+
+    CHECK_VK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    workers->record(context, commandBuffer, firstDraw, lastDraw - firstDraw, workers->userData);
+    CHECK_VK(vkEndCommandBuffer(commandBuffer));
+
+    // Each job owns its slot, the lock taken to count the job as done publishes it
+    workers->jobCommandBuffers[job] = commandBuffer;
+}
+
+static int record_worker(void *data)
+{
+    MyRecordThread *thread = data;
+    MyRecordWorkers *workers = &thread->context->recordWorkers;
+    uint32_t job;
+
+    SDL_LockMutex(workers->lock);
+    for (;;)
+    {
+        while (!workers->quit && workers->startedCount == workers->jobCount)
+        {
+            SDL_CondWait(workers->jobQueued, workers->lock);
+        }
+
+        if (workers->quit)
+        {
+            break;
+        }
+
+        job = workers->startedCount++;
+        SDL_UnlockMutex(workers->lock);
+
+        record_vulkan_job(thread->context, thread, job);
+
+        SDL_LockMutex(workers->lock);
+        if (++workers->doneCount == workers->jobCount)
+        {
+            SDL_CondSignal(workers->jobDone);
+        }
+    }
+
+    SDL_UnlockMutex(workers->lock);
+    return 0;
+}
+
+void create_vulkan_record_workers(MyRenderContext *context)
+{
+    VkResult r;
+    MyRecordWorkers *workers = &context->recordWorkers;
+    VkCommandPoolCreateInfo commandPoolInfo = {0};
+    const char *drawCount = getenv(DRAW_COUNT_ENV);
+
+    context->sceneDrawCount = drawCount && atoi(drawCount) > 0 ? (uint32_t)atoi(drawCount) : 1;
+
+    workers->lock = SDL_CreateMutex();
+    workers->jobQueued = SDL_CreateCond();
+    workers->jobDone = SDL_CreateCond();
+    if (!workers->lock || !workers->jobQueued || !workers->jobDone)
+    {
+        fprintf(stderr, "Failed to create record workers synchronization: %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    // Transient pools, their command buffers are only reset all at once with the pool
+    commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolInfo.queueFamilyIndex = context->graphicsQueue.familyIndex;
+
+    // The main thread records jobs too
+    workers->workerCount = CLAMP(SDL_GetCPUCount() - 1, 1, RECORD_MAX_WORKERS);
+    for (uint32_t i = 0; i <= workers->workerCount; i++)
+    {
+        workers->threads[i].context = context;
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            CHECK_VK(vkCreateCommandPool(context->logicalDevice, &commandPoolInfo, context->allocationCallbacks,
+                &workers->threads[i].commandPools[frame]));
+        }
+    }
+
+    for (uint32_t i = 0; i < workers->workerCount; i++)
+    {
+        if ((workers->workers[i] = SDL_CreateThread(record_worker, "record_worker", workers->threads + i)) == NULL)
+        {
+            fprintf(stderr, "Failed to create record worker: %s\n", SDL_GetError());
+            exit(1);
+        }
+    }
+}
+
+void destroy_vulkan_record_workers(MyRenderContext *context)
+{
+    MyRecordWorkers *workers = &context->recordWorkers;
+
+    if (!workers->lock)
+    {
+        return;
+    }
+
+    SDL_LockMutex(workers->lock);
+    workers->quit = VK_TRUE;
+    SDL_CondBroadcast(workers->jobQueued);
+    SDL_UnlockMutex(workers->lock);
+
+    for (uint32_t i = 0; i < workers->workerCount; i++)
+    {
+        SDL_WaitThread(workers->workers[i], NULL);
+    }
+
+    // Destroying a pool frees its command buffers
+    for (uint32_t i = 0; i <= workers->workerCount; i++)
+    {
+        for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            vkDestroyCommandPool(context->logicalDevice, workers->threads[i].commandPools[frame], context->allocationCallbacks);
+            free(workers->threads[i].commandBuffers[frame]);
+        }
+    }
+
+    SDL_DestroyCond(workers->jobDone);
+    SDL_DestroyCond(workers->jobQueued);
+    SDL_DestroyMutex(workers->lock);
+    memset(workers, 0, sizeof(MyRecordWorkers));
+}
+
+void reset_vulkan_record_pools(MyRenderContext *context, uint32_t frameInFlightIndex)
+{
+    VkResult r;
+    MyRecordWorkers *workers = &context->recordWorkers;
+
+    for (uint32_t i = 0; workers->lock && i <= workers->workerCount; i++)
+    {
+        // Pools no job recorded from are left alone
+        if (workers->threads[i].usedCount[frameInFlightIndex] > 0)
+        {
+            CHECK_VK(vkResetCommandPool(context->logicalDevice, workers->threads[i].commandPools[frameInFlightIndex], 0));
+            workers->threads[i].usedCount[frameInFlightIndex] = 0;
+        }
+    }
+}
+
+void record_vulkan_parallel_commands(MyRenderContext *context, VkCommandBuffer commandBuffer,
+    const VkCommandBufferInheritanceInfo *inheritance, uint32_t drawCount, MyRecordFunc record, void *userData)
+{
+    MyRecordWorkers *workers = &context->recordWorkers;
+    MyRecordThread *mainThread = workers->threads + workers->workerCount;
+    uint32_t job;
+
+    if (drawCount == 0)
+    {
+        return;
+    }
+
+    SDL_LockMutex(workers->lock);
+    workers->inheritance = inheritance;
+    workers->record = record;
+    workers->userData = userData;
+    workers->frameInFlightIndex = context->frameStats.frameInFlightIndex;
+    workers->drawCount = drawCount;
+    // Small batches are not worth waking the workers for
+    workers->jobCount = CLAMP((drawCount + RECORD_MIN_DRAWS_PER_JOB - 1) / RECORD_MIN_DRAWS_PER_JOB, 1, workers->workerCount + 1);
+    workers->startedCount = 0;
+    workers->doneCount = 0;
+    if (workers->jobCount > 1)
+    {
+        SDL_CondBroadcast(workers->jobQueued);
+    }
+
+    // The main thread takes jobs as well instead of idling
+    while (workers->startedCount < workers->jobCount)
+    {
+        job = workers->startedCount++;
+        SDL_UnlockMutex(workers->lock);
+
+        record_vulkan_job(context, mainThread, job);
+
+        SDL_LockMutex(workers->lock);
+        workers->doneCount++;
+    }
+
+    while (workers->doneCount < workers->jobCount)
+    {
+        SDL_CondWait(workers->jobDone, workers->lock);
+    }
+
+    SDL_UnlockMutex(workers->lock);
+
+    // Executed in job order, the draws keep the order of the inline recording
+    vkCmdExecuteCommands(commandBuffer, workers->jobCount, workers->jobCommandBuffers);
+}
+
+void toggle_vulkan_parallel_recording(MyRenderContext *context)
+{
+    context->useParallelRecording = !context->useParallelRecording;
+    if (context->useParallelRecording)
+    {
+        printf("Recording %u draws in secondary command buffers on up to %u threads\n", context->sceneDrawCount,
+            context->recordWorkers.workerCount + 1);
+    }
+    else
+    {
+        printf("Recording %u draws in the primary command buffer\n", context->sceneDrawCount);
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "common.h"
+
+// Worker threads recording secondary command buffers from their own per frame in flight command pools
+void create_vulkan_record_workers(MyRenderContext *context);
+void destroy_vulkan_record_workers(MyRenderContext *context);
+// The GPU is done with the frame in flight, its secondaries can be recorded again
+void reset_vulkan_record_pools(MyRenderContext *context, uint32_t frameInFlightIndex);
+// Splits the draws in jobs recorded in parallel with the inheritance info of the current render pass or dynamic rendering,
+// which must have been begun with secondary command buffer contents, and executes them into commandBuffer in draw order
+void record_vulkan_parallel_commands(MyRenderContext *context, VkCommandBuffer commandBuffer,
+    const VkCommandBufferInheritanceInfo *inheritance, uint32_t drawCount, MyRecordFunc record, void *userData);
+void toggle_vulkan_parallel_recording(MyRenderContext *context);
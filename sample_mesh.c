@@ -1,4 +1,9 @@
 #include "common.h"
+#include "host_memory.h"
+#include "pipeline_state.h"
+#include "record_workers.h"
+#include "shader_object.h"
+#include "vmemory.h"
 #include "vbuffer.h"
 
 static const char *sample_name = "Dynamic render with vertex and index buffers";
@@ -21,119 +26,69 @@ void setup_vertex_description(VkVertexInputBindingDescription *bindingDesc, VkVe
     attributeDesc->offset = offsetof(Vertex, pos);
 }
 
-void create_vulkan_pipeline(MyRenderContext *context)
+// The description is kept as the draw state, its dynamic states are set while recording
+MyPipelineId create_vulkan_pipeline(MyRenderContext *context, MyPipelineDesc *desc)
 {
-    VkResult r;
-    VkPipelineShaderStageCreateInfo shaderStages[3] = {0};
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {0};
-    VkPipelineViewportStateCreateInfo viewportStateInfo = {0};
-    VkPipelineRasterizationStateCreateInfo rasterizerInfo = {0};
-    VkPipelineMultisampleStateCreateInfo multisamplingInfo = {0};
-    VkPipelineColorBlendAttachmentState colorBlendAttachmentInfo = {0};
-    VkPipelineColorBlendStateCreateInfo colorBlendingInfo = {0};
-    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamicStateInfo = {0};
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
-    VkGraphicsPipelineCreateInfo pipelineInfo = {0};
-    VkPipelineRenderingCreateInfo pipelineRenderingCreateInfo = {0};
-    VkPushConstantRange pushConstantRange = {0};
-    VkVertexInputBindingDescription bindingDesc = {0};
-    VkVertexInputAttributeDescription attributeDesc = {0};
-
-    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaderStages[0].module = load_vulkan_shader_module(context->logicalDevice, "shaders/mesh.vert.spv");
-    shaderStages[0].pName = "main"; // Entry point name
-
-    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[1].stage = VK_SHADER_STAGE_GEOMETRY_BIT;
-    shaderStages[1].module = load_vulkan_shader_module(context->logicalDevice, "shaders/mesh.geom.spv");
-    shaderStages[1].pName = "main"; // Entry point name
-
-    shaderStages[2].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[2].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaderStages[2].module = load_vulkan_shader_module(context->logicalDevice, "shaders/mesh.frag.spv");
-    shaderStages[2].pName = "main"; // Entry point name
-
-    setup_vertex_description(&bindingDesc, &attributeDesc);
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDesc;
-    vertexInputInfo.vertexAttributeDescriptionCount = 1;
-    vertexInputInfo.pVertexAttributeDescriptions = &attributeDesc;
-
-    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-    viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportStateInfo.viewportCount = 1;
-    viewportStateInfo.scissorCount = 1;
-
-    rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizerInfo.depthClampEnable = VK_FALSE;
-    rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
-    rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizerInfo.lineWidth = 1.0f;
-    rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizerInfo.depthBiasEnable = VK_FALSE;
-
-    multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisamplingInfo.sampleShadingEnable = VK_FALSE;
-    multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    colorBlendAttachmentInfo.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachmentInfo.blendEnable = VK_FALSE;
-
-    colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendingInfo.logicOpEnable = VK_FALSE;
-    colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
-    colorBlendingInfo.attachmentCount = 1;
-    colorBlendingInfo.pAttachments = &colorBlendAttachmentInfo;
-    colorBlendingInfo.blendConstants[0] = 0.0f;
-    colorBlendingInfo.blendConstants[1] = 0.0f;
-    colorBlendingInfo.blendConstants[2] = 0.0f;
-    colorBlendingInfo.blendConstants[3] = 0.0f;
-
-    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(VkDynamicState);
-    dynamicStateInfo.pDynamicStates = dynamicStates;
-
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT;
-    pushConstantRange.size = sizeof(MyShaderUniforms);
-    pushConstantRange.offset = 0;
-
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-    CHECK_VK(vkCreatePipelineLayout(context->logicalDevice, &pipelineLayoutInfo, NULL, &context->graphicsPipelineLayout));
-
-    pipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
-    pipelineRenderingCreateInfo.colorAttachmentCount = 1;
-    pipelineRenderingCreateInfo.pColorAttachmentFormats = &context->surfaceFormat.format;
-
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.pNext = &pipelineRenderingCreateInfo;
-    pipelineInfo.stageCount = sizeof(shaderStages) / sizeof(VkPipelineShaderStageCreateInfo);
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-    pipelineInfo.pViewportState = &viewportStateInfo;
-    pipelineInfo.pRasterizationState = &rasterizerInfo;
-    pipelineInfo.pMultisampleState = &multisamplingInfo;
-    pipelineInfo.pColorBlendState = &colorBlendingInfo;
-    pipelineInfo.pDynamicState = &dynamicStateInfo;
-    pipelineInfo.layout = context->graphicsPipelineLayout;
-
-    CHECK_VK(vkCreateGraphicsPipelines(context->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &context->graphicsPipeline));
-
-    vkDestroyShaderModule(context->logicalDevice, shaderStages[0].module, NULL);
-    vkDestroyShaderModule(context->logicalDevice, shaderStages[1].module, NULL);
-    vkDestroyShaderModule(context->logicalDevice, shaderStages[2].module, NULL);
+    init_vulkan_pipeline_desc(context, desc);
+    add_vulkan_pipeline_shader_variant(context, desc, VK_SHADER_STAGE_VERTEX_BIT, "mesh.vert");
+    add_vulkan_pipeline_shader_variant(context, desc, VK_SHADER_STAGE_GEOMETRY_BIT, "mesh.geom");
+    add_vulkan_pipeline_shader_variant(context, desc, VK_SHADER_STAGE_FRAGMENT_BIT, "mesh.frag");
+    add_vulkan_pipeline_dynamic_states(context, desc);
+
+    setup_vertex_description(&desc->vertexBindings[0], &desc->vertexAttributes[0]);
+    desc->vertexBindingCount = 1;
+    desc->vertexAttributeCount = 1;
+
+    // Push constants and descriptor bindings declared by the shaders
+    reflect_vulkan_pipeline_layout(desc);
+    return request_vulkan_pipeline(context, desc);
+}
+
+// Recorded inline into the primary command buffer or by the record workers into secondaries, which inherit no state
+static void record_scene_draws(MyRenderContext *context, VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount,
+    void *userData)
+{
+    VkViewport viewport = {0};
+    VkRect2D scissor = {0};
+    VkDeviceSize offsets[] = {0};
+
+    // Viewport and scissor parameters
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)context->swapchainInfo.extent.width;
+    viewport.height = (float)context->swapchainInfo.extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    scissor.extent = context->swapchainInfo.extent;
+
+    if (context->useShaderObjects)
+    {
+        // bind shaders, all the state is dynamic, viewport and scissor included
+        bind_vulkan_shader_objects(commandBuffer, &context->shaderObjects, &context->drawState, &viewport, &scissor);
+    }
+    else
+    {
+        // set viewport
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        // set scissor
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        // bind pipeline, bind shaders 
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
+        // cull mode, polygon mode, ... of the draw
+        set_vulkan_pipeline_dynamic_state(commandBuffer, &context->drawState);
+    }
+    // setup uniforms
+    vkCmdPushConstants(commandBuffer, context->graphicsPipelineLayout, 
+        context->drawState.layout.pushConstantRanges[0].stageFlags, 0, sizeof(MyShaderUniforms), &context->shaderUniforms);
+    // bind vertex buffer
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context->vertexBuffer.buffer, offsets);
+    // bind index buffer
+    vkCmdBindIndexBuffer(commandBuffer, context->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    // draw batch, the same mesh unless VK_BEGINNER_DRAW_COUNT asks for more draws
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        vkCmdDrawIndexed(commandBuffer, 18, 1, 0, 0, 0);
+    }
 }
 
 void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFlight)
@@ -144,10 +99,9 @@ void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFl
     VkImageMemoryBarrier2 imageLayoutBarrier = {0};
     VkDependencyInfo dependencyInfo = {0};
     VkCommandBufferBeginInfo bufferBeginInfo = {0};
+    VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo = {0};
+    VkCommandBufferInheritanceInfo inheritanceInfo = {0};
     VkClearValue clearColor = {{{0.03f, 0.03f, 0.03f, 1.0f}}};
-    VkViewport viewport = {0};
-    VkRect2D scissor = {0};
-    VkDeviceSize offsets[] = {0};
 
     // Describe render attachment
     renderingAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
@@ -165,6 +119,20 @@ void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFl
     renderingInfo.colorAttachmentCount = 1;
     renderingInfo.pColorAttachments = &renderingAttachment;
 
+    // The secondaries continue the dynamic rendering, they are told its attachment formats instead of a render pass
+    inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    inheritanceRenderingInfo.colorAttachmentCount = 1;
+    inheritanceRenderingInfo.pColorAttachmentFormats = &context->surfaceFormat.format;
+    inheritanceRenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = &inheritanceRenderingInfo;
+
+    if (context->useParallelRecording)
+    {
+        renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    }
+
     bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     // Image layout transition barrier, undefined -> color attachment optimal
     imageLayoutBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
@@ -183,37 +151,27 @@ void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFl
     dependencyInfo.imageMemoryBarrierCount = 1;
     dependencyInfo.pImageMemoryBarriers = &imageLayoutBarrier;
 
-    // Viewport and scissor parameters
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)renderingInfo.renderArea.extent.width;
-    viewport.height = (float)renderingInfo.renderArea.extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    scissor.offset = renderingInfo.renderArea.offset;
-    scissor.extent = renderingInfo.renderArea.extent;
-
     // start recording render commands
     CHECK_VK(vkBeginCommandBuffer(frameInFlight->commandBuffer, &bufferBeginInfo));
+    // Mesh buffers may be still streaming in on the transfer queue
+    acquire_vulkan_buffer(context, frameInFlight, &context->vertexBuffer, 
+        VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+    acquire_vulkan_buffer(context, frameInFlight, &context->indexBuffer, 
+        VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT);
     // Image layout transition barrier, undefined -> color attachment optimal
     vkCmdPipelineBarrier2(frameInFlight->commandBuffer, &dependencyInfo);
     // begin render pass
     vkCmdBeginRendering(frameInFlight->commandBuffer, &renderingInfo);
-    // set viewport
-    vkCmdSetViewport(frameInFlight->commandBuffer, 0, 1, &viewport);
-    // set scissor
-    vkCmdSetScissor(frameInFlight->commandBuffer, 0, 1, &scissor);
-    // bind pipeline, bind shaders 
-    vkCmdBindPipeline(frameInFlight->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
-    // setup uniforms
-    vkCmdPushConstants(frameInFlight->commandBuffer, context->graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | 
-        VK_SHADER_STAGE_GEOMETRY_BIT, 0, sizeof(MyShaderUniforms), &context->shaderUniforms);
-    // bind vertex buffer
-    vkCmdBindVertexBuffers(frameInFlight->commandBuffer, 0, 1, &context->vertexBuffer.buffer, offsets);
-    // bind index buffer
-    vkCmdBindIndexBuffer(frameInFlight->commandBuffer, context->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-    // draw batch 
-    vkCmdDrawIndexed(frameInFlight->commandBuffer, 18, 1, 0, 0, 0);
+    if (context->useParallelRecording)
+    {
+        // record the draws on the worker threads and execute the secondaries in order
+        record_vulkan_parallel_commands(context, frameInFlight->commandBuffer, &inheritanceInfo, context->sceneDrawCount,
+            record_scene_draws, NULL);
+    }
+    else
+    {
+        record_scene_draws(context, frameInFlight->commandBuffer, 0, context->sceneDrawCount, NULL);
+    }
     // end render pass
     vkCmdEndRendering(frameInFlight->commandBuffer);
 
@@ -251,8 +209,19 @@ void load_mesh(MyRenderContext *context)
         0,3,4
     };
 
-    context->vertexBuffer = create_and_upload_vulkan_vbo(context, pyramidVertices, sizeof(pyramidVertices));
-    context->indexBuffer = create_and_upload_vulkan_ibo(context, pyramidIndices, sizeof(pyramidIndices));
+    MyUploadBatch batch;
+
+    // Both buffers are uploaded by a single transfer submit, the first frame waits for it on the GPU
+    begin_vulkan_upload_batch(context, &batch);
+    context->vertexBuffer = upload_vulkan_buffer(context, &batch, pyramidVertices, sizeof(pyramidVertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    context->indexBuffer = upload_vulkan_buffer(context, &batch, pyramidIndices, sizeof(pyramidIndices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    flush_vulkan_upload_batch(context, &batch);
+
+    if (!context->vertexBuffer.buffer || !context->indexBuffer.buffer)
+    {
+        fprintf(stderr, "Failed to upload mesh buffers\n");
+        exit(1);
+    }
 }
 
 void destroy_auxiliary(MyRenderContext *context)
@@ -264,8 +233,9 @@ void destroy_auxiliary(MyRenderContext *context)
 int main(int argc, char **argv)
 {
     int8_t running = VK_TRUE;
-    uint32_t flags = SAMPLE_ENABLE_VSYNC;
+    uint32_t flags = SAMPLE_ENABLE_VSYNC | SAMPLE_HOST_MEMORY_POOL;
     MyRenderContext context = {0};
+    MyPipelineId pipelineId;
     SDL_Event e;
 
     context.sampleName = sample_name;
@@ -282,12 +252,17 @@ int main(int argc, char **argv)
     create_sdl2_vulkan_surface(&context);
     choose_vulkan_physical_device(&context, flags);
     create_vulkan_logical_device(&context);
+    // The pipeline compiles on a worker while the swapchain, command buffers and mesh are set up
+    pipelineId = create_vulkan_pipeline(&context, &context.drawState);
     create_vulkan_swapchain(&context);
-    create_vulkan_pipeline(&context);
     create_vulkan_command_buffers(&context);
     load_mesh(&context);
+    context.graphicsPipeline = get_vulkan_pipeline(&context, pipelineId);
+    context.graphicsPipelineLayout = get_vulkan_pipeline_layout(&context, pipelineId);
+    create_vulkan_shader_objects(&context, &context.drawState, &context.shaderObjects);
 
-    printf("Press escape to quit\n");
+    printf("Press escape to quit, M to print memory statistics, W to toggle wireframe, C to change the cull mode, "
+        "S to switch between pipelines and shader objects, P to toggle parallel recording\n");
 
     while (running)
     {
@@ -306,6 +281,32 @@ int main(int argc, char **argv)
                 {
                     resize_sdl2_vulkan_window(&context);
                 }
+                else if (e.key.keysym.sym == SDLK_m)
+                {
+                    print_vulkan_host_allocator_stats(&context);
+                    print_vulkan_memory_stats(&context);
+                }
+                else if (e.key.keysym.sym == SDLK_w)
+                {
+                    toggle_vulkan_wireframe(&context);
+                }
+                else if (e.key.keysym.sym == SDLK_c)
+                {
+                    cycle_vulkan_cull_mode(&context);
+                }
+                else if (e.key.keysym.sym == SDLK_s)
+                {
+                    toggle_vulkan_shader_objects(&context);
+                }
+                else if (e.key.keysym.sym == SDLK_p)
+                {
+                    toggle_vulkan_parallel_recording(&context);
+                }
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                // Recreated at the next frame, the frames in flight keep the old swapchain
+                context.swapchainInfo.outOfDate = VK_TRUE;
             }
         }
     }
@@ -1,4 +1,8 @@
 #include "common.h"
+#include "host_memory.h"
+#include "pipeline_state.h"
+#include "record_workers.h"
+#include "vmemory.h"
 
 static const char *sample_name = "Minimal vulkan sample";
 
@@ -44,121 +48,69 @@ static void create_vulkan_render_pass(MyRenderContext *context)
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
-    CHECK_VK(vkCreateRenderPass(context->logicalDevice, &renderPassInfo, NULL, &context->renderPass));
+    CHECK_VK(vkCreateRenderPass(context->logicalDevice, &renderPassInfo, context->allocationCallbacks, &context->renderPass));
 }
 
-void create_vulkan_pipeline(MyRenderContext *context)
+// The description is kept as the draw state, its dynamic states are set while recording
+MyPipelineId create_vulkan_pipeline(MyRenderContext *context, MyPipelineDesc *desc)
 {
-    VkResult r;
-    VkPipelineShaderStageCreateInfo shaderStages[2] = {0};
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {0};
-    VkPipelineViewportStateCreateInfo viewportStateInfo = {0};
-    VkPipelineRasterizationStateCreateInfo rasterizerInfo = {0};
-    VkPipelineMultisampleStateCreateInfo multisamplingInfo = {0};
-    VkPipelineColorBlendAttachmentState colorBlendAttachmentInfo = {0};
-    VkPipelineColorBlendStateCreateInfo colorBlendingInfo = {0};
-    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamicStateInfo = {0};
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
-    VkGraphicsPipelineCreateInfo pipelineInfo = {0};
-    VkPushConstantRange pushConstantRange = {0};
-
-    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaderStages[0].module = load_vulkan_shader_module(context->logicalDevice, "shaders/base.vert.spv");
-    shaderStages[0].pName = "main"; // Entry point name
-
-    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaderStages[1].module = load_vulkan_shader_module(context->logicalDevice, "shaders/base.frag.spv");
-    shaderStages[1].pName = "main"; // Entry point name
-
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 0;
-    vertexInputInfo.vertexAttributeDescriptionCount = 0;
-
-    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-    viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportStateInfo.viewportCount = 1;
-    viewportStateInfo.scissorCount = 1;
-
-    rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizerInfo.depthClampEnable = VK_FALSE;
-    rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
-    rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizerInfo.lineWidth = 1.0f;
-    rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizerInfo.depthBiasEnable = VK_FALSE;
-
-    multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisamplingInfo.sampleShadingEnable = VK_FALSE;
-    multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    colorBlendAttachmentInfo.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachmentInfo.blendEnable = VK_FALSE;
-
-    colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendingInfo.logicOpEnable = VK_FALSE;
-    colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
-    colorBlendingInfo.attachmentCount = 1;
-    colorBlendingInfo.pAttachments = &colorBlendAttachmentInfo;
-    colorBlendingInfo.blendConstants[0] = 0.0f;
-    colorBlendingInfo.blendConstants[1] = 0.0f;
-    colorBlendingInfo.blendConstants[2] = 0.0f;
-    colorBlendingInfo.blendConstants[3] = 0.0f;
-
-    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(VkDynamicState);
-    dynamicStateInfo.pDynamicStates = dynamicStates;
-
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pushConstantRange.size = sizeof(MyShaderUniforms);
-    pushConstantRange.offset = 0;
-
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    init_vulkan_pipeline_desc(context, desc);
+    add_vulkan_pipeline_shader_variant(context, desc, VK_SHADER_STAGE_VERTEX_BIT, "base.vert");
+    add_vulkan_pipeline_shader_variant(context, desc, VK_SHADER_STAGE_FRAGMENT_BIT, "base.frag");
+    add_vulkan_pipeline_dynamic_states(context, desc);
+    // Traditional render pass, subpass 0
+    desc->renderPass = context->renderPass;
+    desc->subpass = 0;
+
+    // Push constants and descriptor bindings declared by the shaders
+    reflect_vulkan_pipeline_layout(desc);
+    return request_vulkan_pipeline(context, desc);
+}
 
-    CHECK_VK(vkCreatePipelineLayout(context->logicalDevice, &pipelineLayoutInfo, NULL, &context->graphicsPipelineLayout));
+void destroy_auxiliary(MyRenderContext *context)
+{}
 
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-    pipelineInfo.pViewportState = &viewportStateInfo;
-    pipelineInfo.pRasterizationState = &rasterizerInfo;
-    pipelineInfo.pMultisampleState = &multisamplingInfo;
-    pipelineInfo.pColorBlendState = &colorBlendingInfo;
-    pipelineInfo.pDynamicState = &dynamicStateInfo;
-    pipelineInfo.layout = context->graphicsPipelineLayout;
-    pipelineInfo.renderPass = context->renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+// Recorded inline into the primary command buffer or by the record workers into secondaries, which inherit no state
+static void record_scene_draws(MyRenderContext *context, VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount,
+    void *userData)
+{
+    VkViewport viewport = {0};
+    VkRect2D scissor = {0};
 
-    CHECK_VK(vkCreateGraphicsPipelines(context->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &context->graphicsPipeline));
+    // Viewport and scissor parameters
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)context->swapchainInfo.extent.width;
+    viewport.height = (float)context->swapchainInfo.extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    scissor.extent = context->swapchainInfo.extent;
 
-    vkDestroyShaderModule(context->logicalDevice, shaderStages[0].module, NULL);
-    vkDestroyShaderModule(context->logicalDevice, shaderStages[1].module, NULL);
+    // set viewport
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    // set scissor
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    // bind pipeline, bind shaders 
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
+    // cull mode, polygon mode, ... of the draw
+    set_vulkan_pipeline_dynamic_state(commandBuffer, &context->drawState);
+    // setup uniforms
+    vkCmdPushConstants(commandBuffer, context->graphicsPipelineLayout, 
+        context->drawState.layout.pushConstantRanges[0].stageFlags, 0, sizeof(MyShaderUniforms), &context->shaderUniforms);
+    // draw batch, the same pyramid unless VK_BEGINNER_DRAW_COUNT asks for more draws
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        vkCmdDraw(commandBuffer, 18, 1, 0, 0);
+    }
 }
 
-void destroy_auxiliary(MyRenderContext *context)
-{}
-
 void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFlight)
 {
     VkResult r;
     VkCommandBufferBeginInfo bufferBeginInfo = {0};
     VkRenderPassBeginInfo renderPassInfo = {0};
+    VkCommandBufferInheritanceInfo inheritanceInfo = {0};
     VkClearValue clearColor = {{{0.03f, 0.03f, 0.03f, 1.0f}}};
-    VkViewport viewport = {0};
-    VkRect2D scissor = {0};
 
     bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -172,31 +124,27 @@ void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFl
     renderPassInfo.clearValueCount = 1;
     renderPassInfo.pClearValues = &clearColor;
 
-    // Viewport and scissor parameters
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)renderPassInfo.renderArea.extent.width;
-    viewport.height = (float)renderPassInfo.renderArea.extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    scissor.offset = renderPassInfo.renderArea.offset;
-    scissor.extent = renderPassInfo.renderArea.extent;
+    // The secondaries continue subpass 0 of the render pass
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = context->renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
 
     // start recording render commands
     CHECK_VK(vkBeginCommandBuffer(frameInFlight->commandBuffer, &bufferBeginInfo));
     // begin the render pass, declare where we want to render (clears the framebuffer and sets the render area)
-    vkCmdBeginRenderPass(frameInFlight->commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    // set viewport
-    vkCmdSetViewport(frameInFlight->commandBuffer, 0, 1, &viewport);
-    // set scissor
-    vkCmdSetScissor(frameInFlight->commandBuffer, 0, 1, &scissor);
-    // bind pipeline, bind shaders 
-    vkCmdBindPipeline(frameInFlight->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
-    // setup uniforms
-    vkCmdPushConstants(frameInFlight->commandBuffer, context->graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, 
-        sizeof(MyShaderUniforms), &context->shaderUniforms);
-    // draw batch 
-    vkCmdDraw(frameInFlight->commandBuffer, 18, 1, 0, 0);
+    if (context->useParallelRecording)
+    {
+        // the subpass only executes secondaries, recorded on the worker threads and executed in order
+        vkCmdBeginRenderPass(frameInFlight->commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        record_vulkan_parallel_commands(context, frameInFlight->commandBuffer, &inheritanceInfo, context->sceneDrawCount,
+            record_scene_draws, NULL);
+    }
+    else
+    {
+        vkCmdBeginRenderPass(frameInFlight->commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        record_scene_draws(context, frameInFlight->commandBuffer, 0, context->sceneDrawCount, NULL);
+    }
     // end render pass
     vkCmdEndRenderPass(frameInFlight->commandBuffer);
     // end recording render commands
@@ -206,8 +154,9 @@ void record_render_commands(MyRenderContext *context, MyFrameInFlight *frameInFl
 int main(int argc, char **argv)
 {
     int8_t running = VK_TRUE;
-    uint32_t flags = SAMPLE_ENABLE_VSYNC;
+    uint32_t flags = SAMPLE_ENABLE_VSYNC | SAMPLE_HOST_MEMORY_POOL;
     MyRenderContext context = {0};
+    MyPipelineId pipelineId;
     SDL_Event e;
 
     context.sampleName = sample_name;
@@ -225,11 +174,15 @@ int main(int argc, char **argv)
     choose_vulkan_physical_device(&context, flags);
     create_vulkan_logical_device(&context);
     create_vulkan_render_pass(&context);
+    // The pipeline compiles on a worker while the swapchain and command buffers are set up
+    pipelineId = create_vulkan_pipeline(&context, &context.drawState);
     create_vulkan_swapchain(&context);
-    create_vulkan_pipeline(&context);
     create_vulkan_command_buffers(&context);
+    context.graphicsPipeline = get_vulkan_pipeline(&context, pipelineId);
+    context.graphicsPipelineLayout = get_vulkan_pipeline_layout(&context, pipelineId);
 
-    printf("Press escape to quit\n");
+    printf("Press escape to quit, M to print memory statistics, W to toggle wireframe, C to change the cull mode, "
+        "P to toggle parallel recording\n");
 
     while (running)
     {
@@ -248,6 +201,28 @@ int main(int argc, char **argv)
                 {
                     resize_sdl2_vulkan_window(&context);
                 }
+                else if (e.key.keysym.sym == SDLK_m)
+                {
+                    print_vulkan_host_allocator_stats(&context);
+                    print_vulkan_memory_stats(&context);
+                }
+                else if (e.key.keysym.sym == SDLK_w)
+                {
+                    toggle_vulkan_wireframe(&context);
+                }
+                else if (e.key.keysym.sym == SDLK_c)
+                {
+                    cycle_vulkan_cull_mode(&context);
+                }
+                else if (e.key.keysym.sym == SDLK_p)
+                {
+                    toggle_vulkan_parallel_recording(&context);
+                }
+            }
+            else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                // Recreated at the next frame, the frames in flight keep the old swapchain
+                context.swapchainInfo.outOfDate = VK_TRUE;
             }
         }
     }
@@ -1,64 +1,220 @@
 #include "shader_io.h"
 
 #include <stdio.h>
+#include <string.h>
 
-int read_file_to_memory(const char* path, void *buffer, size_t* size)
+#define SHADER_DIR_ENV      "VK_BEGINNER_SHADER_DIR"
+#define SHADER_PATH_MAX     1024
+
+int load_file_to_memory(const char *path, MyMappedFile *file)
 {
     SDL_RWops *handle;
-    
+    int64_t size;
+    void *data;
+
+    file->data = NULL;
+    file->size = 0;
+    file->embedded = VK_FALSE;
+
     if ((handle = SDL_RWFromFile(path, "rb")) == NULL)
     {
         fprintf(stderr, "Failed to open file %s: %s\n", path, SDL_GetError());
         return VK_FALSE;
     }
 
-    if (!buffer)
+    if ((size = SDL_RWsize(handle)) <= 0)
     {
-        int64_t s = SDL_RWsize(handle);
-        if (s < 0)
-        {
-            fprintf(stderr, "Failed to get file size of %s: %s\n", path, SDL_GetError());
-            SDL_RWclose(handle);
-            return VK_FALSE;
-        }
-
-        *size = s;
+        fprintf(stderr, "Failed to get file size of %s: %s\n", path, SDL_GetError());
         SDL_RWclose(handle);
-        return VK_TRUE;
+        return VK_FALSE;
     }
 
+    // A single sized read into a buffer
+    if ((data = malloc((size_t)size)) == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %lld bytes for file %s\n", (long long)size, path);
+        SDL_RWclose(handle);
+        return VK_FALSE;
+    }
 
-    if (SDL_RWread(handle, buffer, *size, 1) != 1)
+    if (SDL_RWread(handle, data, (size_t)size, 1) != 1)
     {
-        fprintf(stderr, "Failed to read file %s: %s", path, SDL_GetError());
+        fprintf(stderr, "Failed to read file %s: %s\n", path, SDL_GetError());
         SDL_RWclose(handle);
-        return 0;
+        free(data);
+        return VK_FALSE;
     }
 
     SDL_RWclose(handle);
-    return 1;
+    file->data = data;
+    file->size = (size_t)size;
+    return VK_TRUE;
+}
+
+void unmap_file_from_memory(MyMappedFile *file)
+{
+    if (!file->embedded)
+    {
+        free((void *)file->data);
+    }
+
+    file->data = NULL;
+    file->size = 0;
+    file->embedded = VK_FALSE;
+}
+
+int validate_spirv_code(const char *name, const void *code, size_t size)
+{
+    if (size < SPIRV_HEADER_SIZE || size % sizeof(uint32_t) != 0)
+    {
+        fprintf(stderr, "Invalid SPIR-V %s: size %zu is not a multiple of 4 or too small\n", name, size);
+        return VK_FALSE;
+    }
+
+    // pCode must be uint32_t aligned
+    if ((uintptr_t)code % sizeof(uint32_t) != 0)
+    {
+        fprintf(stderr, "Invalid SPIR-V %s: code is not 4 bytes aligned\n", name);
+        return VK_FALSE;
+    }
+
+    if (((const uint32_t *)code)[0] != SPIRV_MAGIC)
+    {
+        fprintf(stderr, "Invalid SPIR-V %s: bad magic number 0x%08x\n", name, ((const uint32_t *)code)[0]);
+        return VK_FALSE;
+    }
+
+    return VK_TRUE;
 }
 
-VkShaderModule load_vulkan_shader_module(VkDevice logicalDevice, const char *filename)
+VkShaderModule create_vulkan_shader_module(VkDevice logicalDevice, const VkAllocationCallbacks *allocator, const uint32_t *code, 
+    size_t size)
 {
-    VkResult r;
     VkShaderModuleCreateInfo createInfo = {0};
     VkShaderModule shaderModule;
-    void *shaderCode;
-    size_t shaderSize;
 
-    if (!read_file_to_memory(filename, NULL, &shaderSize))
-        exit(1);
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = size;
+    createInfo.pCode = code;
 
-    shaderCode = malloc(shaderSize);
-    if (!read_file_to_memory(filename, shaderCode, &shaderSize))
-        exit(1);
+    if (vkCreateShaderModule(logicalDevice, &createInfo, allocator, &shaderModule) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
 
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = shaderSize;
-    createInfo.pCode = shaderCode;
+    return shaderModule;
+}
+
+const MyEmbeddedShader *find_embedded_shader(const char *name)
+{
+    for (uint32_t i = 0; i < embeddedShaderCount; i++)
+    {
+        if (strcmp(embeddedShaders[i].name, name) == 0)
+        {
+            return &embeddedShaders[i];
+        }
+    }
+
+    return NULL;
+}
+
+const char *get_vulkan_shader_dir(void)
+{
+    const char *shaderDir = getenv(SHADER_DIR_ENV);
+
+    return shaderDir && shaderDir[0] ? shaderDir : NULL;
+}
+
+int get_vulkan_shader_code(const char *name, MyMappedFile *file)
+{
+    const MyEmbeddedShader *shader;
+    const char *shaderDir = get_vulkan_shader_dir();
+    char path[SHADER_PATH_MAX];
+
+    // Shaders rebuilt on disk take priority, no need to relink the sample while iterating on them.
+    // Read rather than mapped: glslc truncates and rewrites the files under hot reload, reading a truncated mapping
+    // on a pipeline worker would raise SIGBUS.
+    if (shaderDir)
+    {
+        snprintf(path, sizeof(path), "%s/%s.spv", shaderDir, name);
+        if (!load_file_to_memory(path, file))
+        {
+            return VK_FALSE;
+        }
+    }
+    else if ((shader = find_embedded_shader(name)) != NULL)
+    {
+        file->data = shader->code;
+        file->size = shader->size;
+        file->embedded = VK_TRUE;
+    }
+    else
+    {
+        fprintf(stderr, "Shader %s is not embedded, set %s to load it from disk\n", name, SHADER_DIR_ENV);
+        return VK_FALSE;
+    }
+
+    if (!validate_spirv_code(name, file->data, file->size))
+    {
+        unmap_file_from_memory(file);
+        return VK_FALSE;
+    }
+
+    return VK_TRUE;
+}
+
+const char *select_vulkan_shader_variant(uint32_t features, const char *name)
+{
+    const MyShaderVariant *selected = NULL;
+
+    for (uint32_t i = 0; i < embeddedShaderVariantCount; i++)
+    {
+        const MyShaderVariant *variant = &embeddedShaderVariants[i];
+
+        if (strcmp(variant->shader, name) != 0 || (variant->requiredFeatures & features) != variant->requiredFeatures)
+        {
+            continue;
+        }
+
+        if (selected == NULL || variant->cost < selected->cost)
+        {
+            selected = variant;
+        }
+    }
+
+    if (selected == NULL)
+    {
+        return name;
+    }
+
+    printf("Shader %s: using variant %s\n", name, selected->name);
+    return selected->name;
+}
+
+int try_get_vulkan_shader_module(VkDevice logicalDevice, const VkAllocationCallbacks *allocator, const char *name,
+    VkShaderModule *shaderModule)
+{
+    MyMappedFile file = {0};
+
+    if (!get_vulkan_shader_code(name, &file))
+    {
+        return VK_FALSE;
+    }
+
+    *shaderModule = create_vulkan_shader_module(logicalDevice, allocator, file.data, file.size);
+    unmap_file_from_memory(&file);
+    return *shaderModule != VK_NULL_HANDLE;
+}
+
+VkShaderModule get_vulkan_shader_module(VkDevice logicalDevice, const VkAllocationCallbacks *allocator, const char *name)
+{
+    VkShaderModule shaderModule;
+
+    if (!try_get_vulkan_shader_module(logicalDevice, allocator, name, &shaderModule))
+    {
+        fprintf(stderr, "Failed to create shader module %s\n", name);
+        exit(1);
+    }
 
-    CHECK_VK(vkCreateShaderModule(logicalDevice, &createInfo, NULL, &shaderModule));
-    free(shaderCode);
     return shaderModule;
 }
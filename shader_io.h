@@ -2,5 +2,61 @@
 
 #include "vulkan.h"
 
-int read_file_to_memory(const char* path, void *buffer, size_t* size);
-VkShaderModule load_vulkan_shader_module(VkDevice logicalDevice, const char *filename);
\ No newline at end of file
+#define SPIRV_MAGIC         0x07230203
+#define SPIRV_HEADER_SIZE   (5 * sizeof(uint32_t))
+
+typedef struct MyMappedFile
+{
+    const void *data;
+    size_t size;
+    uint8_t embedded; // points to an embedded shader, nothing to release, otherwise a malloc-ed buffer
+} MyMappedFile;
+
+typedef struct MyEmbeddedShader
+{
+    const char *name; // file name without .spv, like "base.vert"
+    const uint32_t *code;
+    size_t size;
+} MyEmbeddedShader;
+
+// Device features a shader variant can require, REQUIRES of add_shader_variant in CMakeLists.txt
+#define SHADER_FEATURE_FLOAT16      0x1u // shaderFloat16, 16 bit float arithmetic
+
+// Permutation of a shader compiled with extra macro definitions
+typedef struct MyShaderVariant
+{
+    const char *shader; // name of the shader compiled without definitions, like "base.frag"
+    const char *name; // registry name of the variant, like "base.frag.half"
+    uint32_t cost; // relative, the lowest supported cost is selected
+    uint32_t requiredFeatures; // SHADER_FEATURE_* bits
+} MyShaderVariant;
+
+// Generated at build time from the compiled shaders, see cmake/embed_spirv.cmake
+extern const MyEmbeddedShader embeddedShaders[];
+extern const uint32_t embeddedShaderCount;
+extern const MyShaderVariant embeddedShaderVariants[];
+extern const uint32_t embeddedShaderVariantCount;
+
+// Single sized read into a malloc-ed buffer, safe against the file being rewritten afterwards
+int load_file_to_memory(const char *path, MyMappedFile *file);
+void unmap_file_from_memory(MyMappedFile *file);
+// Checks the SPIR-V magic number, size and alignment
+int validate_spirv_code(const char *name, const void *code, size_t size);
+// Returns VK_NULL_HANDLE if the driver rejects the code
+VkShaderModule create_vulkan_shader_module(VkDevice logicalDevice, const VkAllocationCallbacks *allocator, const uint32_t *code, 
+    size_t size);
+// Shader registry, returns NULL if no shader with this name was embedded
+const MyEmbeddedShader *find_embedded_shader(const char *name);
+// Value of VK_BEGINNER_SHADER_DIR, NULL if the embedded shaders are used
+const char *get_vulkan_shader_dir(void);
+// Validated SPIR-V of name.spv from VK_BEGINNER_SHADER_DIR if set, otherwise of the embedded shader.
+// Released with unmap_file_from_memory.
+int get_vulkan_shader_code(const char *name, MyMappedFile *file);
+// Registry name of the cheapest variant of the shader whose required features are all in features,
+// name itself if there is none
+const char *select_vulkan_shader_variant(uint32_t features, const char *name);
+// Loads name.spv from VK_BEGINNER_SHADER_DIR if set, otherwise uses the embedded shader
+int try_get_vulkan_shader_module(VkDevice logicalDevice, const VkAllocationCallbacks *allocator, const char *name,
+    VkShaderModule *shaderModule);
+// Same as try_get_vulkan_shader_module, exits on failure
+VkShaderModule get_vulkan_shader_module(VkDevice logicalDevice, const VkAllocationCallbacks *allocator, const char *name);
@@ -0,0 +1,198 @@
+#include "shader_object.h"
+#include "pipeline_state.h"
+
+#include <string.h>
+
+// Slots of MyShaderObjects.shaders, the geometry shader feature is enabled so its stage must always be bound
+static const VkShaderStageFlagBits shaderObjectStages[PIPELINE_MAX_SHADER_STAGES] = {
+    VK_SHADER_STAGE_VERTEX_BIT,
+    VK_SHADER_STAGE_GEOMETRY_BIT,
+    VK_SHADER_STAGE_FRAGMENT_BIT
+};
+
+static uint32_t get_shader_object_slot(VkShaderStageFlagBits stage)
+{
+    for (uint32_t i = 0; i < PIPELINE_MAX_SHADER_STAGES; i++)
+    {
+        if (shaderObjectStages[i] == stage)
+        {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+int create_vulkan_shader_objects(MyRenderContext *context, const MyPipelineDesc *desc, MyShaderObjects *objects)
+{
+    VkShaderCreateInfoEXT createInfos[PIPELINE_MAX_SHADER_STAGES] = {0};
+    MyMappedFile files[PIPELINE_MAX_SHADER_STAGES] = {0};
+    VkShaderEXT shaders[PIPELINE_MAX_SHADER_STAGES] = {0};
+    VkDescriptorSetLayout setLayouts[PIPELINE_MAX_DESCRIPTOR_SETS];
+    uint32_t setLayoutCount;
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    uint8_t loaded = VK_TRUE;
+
+    memset(objects, 0, sizeof(MyShaderObjects));
+    if (!context->supportedFeatures.shaderObjectSupport)
+    {
+        return VK_FALSE;
+    }
+
+    // Set layouts of the pipeline layout, descriptor sets bound with it work for the shader objects too
+    setLayoutCount = get_vulkan_descriptor_set_layouts(context, &desc->layout, setLayouts);
+    for (uint32_t i = 0; i < desc->shaderCount; i++)
+    {
+        if (get_shader_object_slot(desc->shaders[i].stage) == UINT32_MAX || !get_vulkan_shader_code(desc->shaders[i].name, &files[i]))
+        {
+            loaded = VK_FALSE;
+            break;
+        }
+
+        createInfos[i].sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+        // Linked shaders are optimized across the stages like the stages of a pipeline
+        createInfos[i].flags = desc->shaderCount > 1 ? VK_SHADER_CREATE_LINK_STAGE_BIT_EXT : 0;
+        createInfos[i].stage = desc->shaders[i].stage;
+        createInfos[i].nextStage = i + 1 < desc->shaderCount ? desc->shaders[i + 1].stage : 0;
+        createInfos[i].codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        createInfos[i].codeSize = files[i].size;
+        createInfos[i].pCode = files[i].data;
+        createInfos[i].pName = "main";
+        // Same push constant ranges as the pipeline layout, so the layout of the pipeline works for vkCmdPushConstants
+        createInfos[i].pushConstantRangeCount = desc->layout.pushConstantRangeCount;
+        createInfos[i].pPushConstantRanges = desc->layout.pushConstantRanges;
+        createInfos[i].setLayoutCount = setLayoutCount;
+        createInfos[i].pSetLayouts = setLayouts;
+    }
+
+    if (loaded)
+    {
+        result = vkCreateShadersEXT(context->logicalDevice, desc->shaderCount, createInfos, context->allocationCallbacks, shaders);
+    }
+
+    for (uint32_t i = 0; i < desc->shaderCount; i++)
+    {
+        if (files[i].data)
+        {
+            unmap_file_from_memory(&files[i]);
+        }
+
+        if (result != VK_SUCCESS && shaders[i])
+        {
+            vkDestroyShaderEXT(context->logicalDevice, shaders[i], context->allocationCallbacks);
+        }
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to create shader objects of %s\n", desc->shaders[0].name);
+        return VK_FALSE;
+    }
+
+    for (uint32_t i = 0; i < desc->shaderCount; i++)
+    {
+        objects->shaders[get_shader_object_slot(desc->shaders[i].stage)] = shaders[i];
+    }
+
+    objects->shaderCount = desc->shaderCount;
+    return VK_TRUE;
+}
+
+void destroy_vulkan_shader_objects(MyRenderContext *context, MyShaderObjects *objects)
+{
+    for (uint32_t i = 0; i < PIPELINE_MAX_SHADER_STAGES; i++)
+    {
+        if (objects->shaders[i])
+        {
+            vkDestroyShaderEXT(context->logicalDevice, objects->shaders[i], context->allocationCallbacks);
+        }
+    }
+
+    memset(objects, 0, sizeof(MyShaderObjects));
+}
+
+void bind_vulkan_shader_objects(VkCommandBuffer commandBuffer, const MyShaderObjects *objects, const MyPipelineDesc *desc,
+    const VkViewport *viewport, const VkRect2D *scissor)
+{
+    VkVertexInputBindingDescription2EXT bindings[PIPELINE_MAX_VERTEX_BINDINGS] = {0};
+    VkVertexInputAttributeDescription2EXT attributes[PIPELINE_MAX_VERTEX_ATTRIBUTES] = {0};
+    VkBool32 blendEnables[PIPELINE_MAX_COLOR_ATTACHMENTS];
+    VkColorBlendEquationEXT blendEquations[PIPELINE_MAX_COLOR_ATTACHMENTS];
+    VkColorComponentFlags writeMasks[PIPELINE_MAX_COLOR_ATTACHMENTS];
+    VkSampleMask sampleMask = UINT32_MAX;
+
+    vkCmdBindShadersEXT(commandBuffer, PIPELINE_MAX_SHADER_STAGES, shaderObjectStages, objects->shaders);
+
+    // Vertex input
+    for (uint32_t i = 0; i < desc->vertexBindingCount; i++)
+    {
+        bindings[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+        bindings[i].binding = desc->vertexBindings[i].binding;
+        bindings[i].stride = desc->vertexBindings[i].stride;
+        bindings[i].inputRate = desc->vertexBindings[i].inputRate;
+        bindings[i].divisor = 1;
+    }
+
+    for (uint32_t i = 0; i < desc->vertexAttributeCount; i++)
+    {
+        attributes[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+        attributes[i].location = desc->vertexAttributes[i].location;
+        attributes[i].binding = desc->vertexAttributes[i].binding;
+        attributes[i].format = desc->vertexAttributes[i].format;
+        attributes[i].offset = desc->vertexAttributes[i].offset;
+    }
+
+    vkCmdSetVertexInputEXT(commandBuffer, desc->vertexBindingCount, bindings, desc->vertexAttributeCount, attributes);
+    vkCmdSetPrimitiveTopology(commandBuffer, desc->topology);
+    vkCmdSetPrimitiveRestartEnable(commandBuffer, VK_FALSE);
+
+    // Rasterization
+    vkCmdSetViewportWithCount(commandBuffer, 1, viewport);
+    vkCmdSetScissorWithCount(commandBuffer, 1, scissor);
+    vkCmdSetRasterizerDiscardEnable(commandBuffer, VK_FALSE);
+    vkCmdSetPolygonModeEXT(commandBuffer, desc->polygonMode);
+    vkCmdSetCullMode(commandBuffer, desc->cullMode);
+    vkCmdSetFrontFace(commandBuffer, desc->frontFace);
+    vkCmdSetDepthBiasEnable(commandBuffer, VK_FALSE);
+    vkCmdSetLineWidth(commandBuffer, 1.0f);
+    vkCmdSetRasterizationSamplesEXT(commandBuffer, desc->samples);
+    vkCmdSetSampleMaskEXT(commandBuffer, desc->samples, &sampleMask);
+    vkCmdSetAlphaToCoverageEnableEXT(commandBuffer, VK_FALSE);
+
+    // No depth and stencil attachments yet
+    vkCmdSetDepthTestEnable(commandBuffer, VK_FALSE);
+    vkCmdSetDepthWriteEnable(commandBuffer, VK_FALSE);
+    vkCmdSetStencilTestEnable(commandBuffer, VK_FALSE);
+
+    // Color blending
+    for (uint32_t i = 0; i < desc->colorAttachmentCount; i++)
+    {
+        blendEnables[i] = desc->blendAttachments[i].blendEnable;
+        blendEquations[i].srcColorBlendFactor = desc->blendAttachments[i].srcColorBlendFactor;
+        blendEquations[i].dstColorBlendFactor = desc->blendAttachments[i].dstColorBlendFactor;
+        blendEquations[i].colorBlendOp = desc->blendAttachments[i].colorBlendOp;
+        blendEquations[i].srcAlphaBlendFactor = desc->blendAttachments[i].srcAlphaBlendFactor;
+        blendEquations[i].dstAlphaBlendFactor = desc->blendAttachments[i].dstAlphaBlendFactor;
+        blendEquations[i].alphaBlendOp = desc->blendAttachments[i].alphaBlendOp;
+        writeMasks[i] = desc->blendAttachments[i].colorWriteMask;
+    }
+
+    if (desc->colorAttachmentCount > 0)
+    {
+        vkCmdSetColorBlendEnableEXT(commandBuffer, 0, desc->colorAttachmentCount, blendEnables);
+        vkCmdSetColorBlendEquationEXT(commandBuffer, 0, desc->colorAttachmentCount, blendEquations);
+        vkCmdSetColorWriteMaskEXT(commandBuffer, 0, desc->colorAttachmentCount, writeMasks);
+    }
+}
+
+void toggle_vulkan_shader_objects(MyRenderContext *context)
+{
+    if (context->shaderObjects.shaderCount == 0)
+    {
+        printf("VK_EXT_shader_object is not available, rendering with pipelines\n");
+        return;
+    }
+
+    context->useShaderObjects = !context->useShaderObjects;
+    printf("Rendering with %s\n", context->useShaderObjects ? "shader objects" : "pipelines");
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common.h"
+
+// VK_EXT_shader_object path, the shaders of a pipeline description are created without a VkPipeline and
+// all the state of the description is set dynamically when they are bound.
+// Returns VK_FALSE if the extension is not supported or a shader fails to load.
+int create_vulkan_shader_objects(MyRenderContext *context, const MyPipelineDesc *desc, MyShaderObjects *objects);
+void destroy_vulkan_shader_objects(MyRenderContext *context, MyShaderObjects *objects);
+// Binds the shaders and sets every state a draw needs from the state description,
+// replaces vkCmdBindPipeline, vkCmdSetViewport and vkCmdSetScissor
+void bind_vulkan_shader_objects(VkCommandBuffer commandBuffer, const MyShaderObjects *objects, const MyPipelineDesc *desc,
+    const VkViewport *viewport, const VkRect2D *scissor);
+// Switches the samples between context->graphicsPipeline and context->shaderObjects
+void toggle_vulkan_shader_objects(MyRenderContext *context);
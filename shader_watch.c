@@ -0,0 +1,105 @@
+#ifdef PLATFORM_Linux
+// read and close are POSIX, inotify is Linux only
+#   define _POSIX_C_SOURCE 200809L
+#   include <errno.h>
+#   include <sys/inotify.h>
+#   include <unistd.h>
+#endif
+
+#include "shader_watch.h"
+#include "pipeline_state.h"
+
+#include <string.h>
+
+#define SHADER_WATCH_EVENT_BUFFER_SIZE 4096
+
+void create_vulkan_shader_watch(MyRenderContext *context)
+{
+#ifdef PLATFORM_Linux
+    const char *shaderDir = get_vulkan_shader_dir();
+
+    context->shaderWatch = -1;
+    if (!shaderDir)
+    {
+        return;
+    }
+
+    if ((context->shaderWatch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+    {
+        fprintf(stderr, "Failed to initialize inotify, shader hot reload is disabled\n");
+        return;
+    }
+
+    // glslc writes the whole file and closes it, editors and build tools may also rename a temporary over it
+    if (inotify_add_watch(context->shaderWatch, shaderDir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        fprintf(stderr, "Failed to watch %s, shader hot reload is disabled\n", shaderDir);
+        close(context->shaderWatch);
+        context->shaderWatch = -1;
+        return;
+    }
+
+    printf("Watching %s for shader changes\n", shaderDir);
+#else
+    context->shaderWatch = -1;
+#endif
+}
+
+void destroy_vulkan_shader_watch(MyRenderContext *context)
+{
+#ifdef PLATFORM_Linux
+    if (context->shaderWatch >= 0)
+    {
+        close(context->shaderWatch);
+    }
+#endif
+
+    context->shaderWatch = -1;
+}
+
+void update_vulkan_shader_watch(MyRenderContext *context)
+{
+#ifdef PLATFORM_Linux
+    // inotify_event is followed by its name, keep the buffer aligned for it
+    union
+    {
+        struct inotify_event event;
+        char bytes[SHADER_WATCH_EVENT_BUFFER_SIZE];
+    } buffer;
+    const struct inotify_event *event;
+    char shaderName[PIPELINE_SHADER_NAME_SIZE];
+    ssize_t length;
+    size_t nameLength;
+
+    if (context->shaderWatch >= 0)
+    {
+        // Non blocking, returns EAGAIN when there are no more events
+        while ((length = read(context->shaderWatch, buffer.bytes, sizeof(buffer.bytes))) > 0)
+        {
+            for (char *p = buffer.bytes; p < buffer.bytes + length; p += sizeof(struct inotify_event) + event->len)
+            {
+                event = (const struct inotify_event *)p;
+                nameLength = event->len ? strlen(event->name) : 0;
+
+                // Shader names are the file names without .spv
+                if (nameLength <= 4 || nameLength - 4 >= sizeof(shaderName) || strcmp(event->name + nameLength - 4, ".spv") != 0)
+                {
+                    continue;
+                }
+
+                memcpy(shaderName, event->name, nameLength - 4);
+                shaderName[nameLength - 4] = '\0';
+                reload_vulkan_pipelines(context, shaderName);
+            }
+        }
+
+        if (length < 0 && errno != EAGAIN)
+        {
+            fprintf(stderr, "Failed to read shader changes, shader hot reload is disabled\n");
+            destroy_vulkan_shader_watch(context);
+        }
+    }
+#endif
+
+    update_vulkan_pipeline_reloads(context);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "common.h"
+
+// Watches VK_BEGINNER_SHADER_DIR with inotify on Linux and rebuilds the pipelines using changed shaders.
+// Does nothing if the embedded shaders are used or on other platforms.
+void create_vulkan_shader_watch(MyRenderContext *context);
+void destroy_vulkan_shader_watch(MyRenderContext *context);
+// Called once per frame at the frame boundary, reads pending events without blocking
+void update_vulkan_shader_watch(MyRenderContext *context);
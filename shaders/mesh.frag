@@ -1,20 +1,31 @@
 #version 450
 
+// Variant compiled by add_shader_variant, requires the shaderFloat16 feature.
+// Only the math is 16 bit, the inputs and outputs stay 32 bit.
+#ifdef HALF_PRECISION
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+#define real float16_t
+#define real3 f16vec3
+#else
+#define real float
+#define real3 vec3
+#endif
+
 layout(location = 0) in vec3 vWNormal;
 layout(location = 0) out vec4 outColor;
 
-const vec3 lightDir = vec3(2.0, -3.0, 5.0);
-const vec3 baseColor = vec3(0.3, 0.6, 0.9);
-const vec3 ambientColor = vec3(0.1);
+const real3 lightDir = real3(2.0, -3.0, 5.0);
+const real3 baseColor = real3(0.3, 0.6, 0.9);
+const real3 ambientColor = real3(0.1);
 
 void main() {
     //outColor = gl_FrontFacing ? vec4(0,1,0,1) : vec4(1,0,0,1);
 
-    vec3 L = normalize(lightDir);
-    vec3 N = normalize(vWNormal);
-    float NdotL = max(dot(N, L), 0.0);
+    real3 L = normalize(lightDir);
+    real3 N = normalize(real3(vWNormal));
+    real NdotL = max(dot(N, L), real(0.0));
 
-    vec3 color = ambientColor + (baseColor * NdotL);
+    real3 color = ambientColor + (baseColor * NdotL);
 
     outColor = vec4(color, 1.0);
 }
@@ -0,0 +1,596 @@
+#include "spirv_reflect.h"
+
+#include <string.h>
+
+// Subset of the SPIR-V specification needed to find the interface of a shader
+#define SPV_OP_ENTRY_POINT          15
+#define SPV_OP_TYPE_VOID            19
+#define SPV_OP_TYPE_BOOL            20
+#define SPV_OP_TYPE_INT             21
+#define SPV_OP_TYPE_FLOAT           22
+#define SPV_OP_TYPE_VECTOR          23
+#define SPV_OP_TYPE_MATRIX          24
+#define SPV_OP_TYPE_IMAGE           25
+#define SPV_OP_TYPE_SAMPLER         26
+#define SPV_OP_TYPE_SAMPLED_IMAGE   27
+#define SPV_OP_TYPE_ARRAY           28
+#define SPV_OP_TYPE_RUNTIME_ARRAY   29
+#define SPV_OP_TYPE_STRUCT          30
+#define SPV_OP_TYPE_POINTER         32
+#define SPV_OP_CONSTANT             43
+#define SPV_OP_SPEC_CONSTANT_TRUE   48
+#define SPV_OP_SPEC_CONSTANT_FALSE  49
+#define SPV_OP_SPEC_CONSTANT        50
+#define SPV_OP_FUNCTION             54
+#define SPV_OP_VARIABLE             59
+#define SPV_OP_DECORATE             71
+#define SPV_OP_MEMBER_DECORATE      72
+
+#define SPV_DECORATION_SPEC_ID          1
+#define SPV_DECORATION_BUFFER_BLOCK     3
+#define SPV_DECORATION_ARRAY_STRIDE     6
+#define SPV_DECORATION_MATRIX_STRIDE    7
+#define SPV_DECORATION_BUILT_IN         11
+#define SPV_DECORATION_LOCATION         30
+#define SPV_DECORATION_BINDING          33
+#define SPV_DECORATION_DESCRIPTOR_SET   34
+#define SPV_DECORATION_OFFSET           35
+
+#define SPV_STORAGE_UNIFORM_CONSTANT    0
+#define SPV_STORAGE_INPUT               1
+#define SPV_STORAGE_UNIFORM             2
+#define SPV_STORAGE_PUSH_CONSTANT       9
+#define SPV_STORAGE_STORAGE_BUFFER      12
+
+#define SPV_DIM_BUFFER          5
+#define SPV_DIM_SUBPASS_DATA    6
+
+#define SPIRV_HEADER_WORDS      5
+// Nesting limit of arrays and structs, also stops on malformed recursive types
+#define SPIRV_MAX_TYPE_DEPTH    16
+
+typedef struct MySpirvId
+{
+    const uint32_t *instruction; // declaration, NULL if the id is not a type, constant or variable
+    uint32_t set;
+    uint32_t binding;
+    uint32_t location;
+    uint32_t specId;
+    uint32_t arrayStride;
+    uint8_t hasBinding;
+    uint8_t hasLocation;
+    uint8_t hasSpecId;
+    uint8_t builtIn;
+    uint8_t bufferBlock;
+} MySpirvId;
+
+typedef struct MySpirvModule
+{
+    const uint32_t *code;
+    uint32_t declarationWords; // words before the first function
+    uint32_t bound;
+    MySpirvId *ids;
+} MySpirvModule;
+
+// Shortest valid instruction for the opcodes read by the reflection, 0 for the others
+static uint32_t get_spirv_min_length(uint32_t opcode)
+{
+    switch (opcode)
+    {
+    case SPV_OP_TYPE_VOID:
+    case SPV_OP_TYPE_BOOL:
+    case SPV_OP_TYPE_SAMPLER:
+    case SPV_OP_TYPE_STRUCT:
+        return 2;
+    case SPV_OP_TYPE_FLOAT:
+    case SPV_OP_TYPE_SAMPLED_IMAGE:
+    case SPV_OP_TYPE_RUNTIME_ARRAY:
+    case SPV_OP_SPEC_CONSTANT_TRUE:
+    case SPV_OP_SPEC_CONSTANT_FALSE:
+    case SPV_OP_DECORATE:
+        return 3;
+    case SPV_OP_ENTRY_POINT:
+    case SPV_OP_TYPE_INT:
+    case SPV_OP_TYPE_VECTOR:
+    case SPV_OP_TYPE_MATRIX:
+    case SPV_OP_TYPE_ARRAY:
+    case SPV_OP_TYPE_POINTER:
+    case SPV_OP_CONSTANT:
+    case SPV_OP_SPEC_CONSTANT:
+    case SPV_OP_VARIABLE:
+    case SPV_OP_MEMBER_DECORATE:
+        return 4;
+    case SPV_OP_TYPE_IMAGE:
+        return 9;
+    default:
+        return 0;
+    }
+}
+
+static const uint32_t *get_spirv_declaration(const MySpirvModule *module, uint32_t id, uint32_t opcode)
+{
+    const uint32_t *instruction;
+
+    if (id >= module->bound || (instruction = module->ids[id].instruction) == NULL)
+    {
+        return NULL;
+    }
+
+    return (instruction[0] & 0xFFFF) == opcode || opcode == 0 ? instruction : NULL;
+}
+
+static void decorate_spirv_id(MySpirvId *id, uint32_t decoration, uint32_t value)
+{
+    switch (decoration)
+    {
+    case SPV_DECORATION_SPEC_ID:
+        id->specId = value;
+        id->hasSpecId = VK_TRUE;
+        break;
+    case SPV_DECORATION_BUFFER_BLOCK:
+        id->bufferBlock = VK_TRUE;
+        break;
+    case SPV_DECORATION_ARRAY_STRIDE:
+        id->arrayStride = value;
+        break;
+    case SPV_DECORATION_BUILT_IN:
+        id->builtIn = VK_TRUE;
+        break;
+    case SPV_DECORATION_LOCATION:
+        id->location = value;
+        id->hasLocation = VK_TRUE;
+        break;
+    case SPV_DECORATION_BINDING:
+        id->binding = value;
+        id->hasBinding = VK_TRUE;
+        break;
+    case SPV_DECORATION_DESCRIPTOR_SET:
+        id->set = value;
+        break;
+    default:
+        break;
+    }
+}
+
+static uint32_t get_spirv_member_decoration(const MySpirvModule *module, uint32_t structId, uint32_t member,
+    uint32_t decoration)
+{
+    const uint32_t *instruction;
+    uint32_t length;
+
+    for (uint32_t offset = SPIRV_HEADER_WORDS; offset < module->declarationWords; offset += length)
+    {
+        instruction = module->code + offset;
+        length = instruction[0] >> 16;
+        if ((instruction[0] & 0xFFFF) == SPV_OP_MEMBER_DECORATE && length >= 5 && instruction[1] == structId &&
+            instruction[2] == member && instruction[3] == decoration)
+        {
+            return instruction[4];
+        }
+    }
+
+    return 0;
+}
+
+// Array lengths are constants or specialization constants, the default value is used for the latter
+static uint32_t get_spirv_array_length(const MySpirvModule *module, uint32_t constantId)
+{
+    const uint32_t *constant;
+
+    if ((constant = get_spirv_declaration(module, constantId, SPV_OP_CONSTANT)) == NULL &&
+        (constant = get_spirv_declaration(module, constantId, SPV_OP_SPEC_CONSTANT)) == NULL)
+    {
+        return 1;
+    }
+
+    return constant[3];
+}
+
+// Size in a block with explicit layout, matrixStride comes from the struct member holding the matrix
+static uint32_t get_spirv_type_size(const MySpirvModule *module, uint32_t typeId, uint32_t matrixStride, uint32_t depth)
+{
+    const uint32_t *type = get_spirv_declaration(module, typeId, 0);
+    uint32_t memberEnd, size = 0;
+
+    if (type == NULL || depth > SPIRV_MAX_TYPE_DEPTH)
+    {
+        return 0;
+    }
+
+    switch (type[0] & 0xFFFF)
+    {
+    case SPV_OP_TYPE_BOOL:
+        return sizeof(uint32_t);
+    case SPV_OP_TYPE_INT:
+    case SPV_OP_TYPE_FLOAT:
+        return type[2] / 8;
+    case SPV_OP_TYPE_VECTOR:
+        return type[3] * get_spirv_type_size(module, type[2], 0, depth + 1);
+    case SPV_OP_TYPE_MATRIX:
+        return type[3] * (matrixStride ? matrixStride : get_spirv_type_size(module, type[2], 0, depth + 1));
+    case SPV_OP_TYPE_ARRAY:
+        return get_spirv_array_length(module, type[3]) * (module->ids[typeId].arrayStride ? module->ids[typeId].arrayStride :
+            get_spirv_type_size(module, type[2], matrixStride, depth + 1));
+    case SPV_OP_TYPE_STRUCT:
+        for (uint32_t i = 0; i < (type[0] >> 16) - 2; i++)
+        {
+            memberEnd = get_spirv_member_decoration(module, typeId, i, SPV_DECORATION_OFFSET) + get_spirv_type_size(module,
+                type[2 + i], get_spirv_member_decoration(module, typeId, i, SPV_DECORATION_MATRIX_STRIDE), depth + 1);
+            size = memberEnd > size ? memberEnd : size;
+        }
+        return size;
+    default:
+        // Runtime arrays have no size
+        return 0;
+    }
+}
+
+static VkFormat get_spirv_vertex_input_format(const MySpirvModule *module, uint32_t typeId)
+{
+    static const VkFormat formats[4][3] = {
+        {VK_FORMAT_R32_UINT, VK_FORMAT_R32_SINT, VK_FORMAT_R32_SFLOAT},
+        {VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32_SFLOAT},
+        {VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32_SFLOAT},
+        {VK_FORMAT_R32G32B32A32_UINT, VK_FORMAT_R32G32B32A32_SINT, VK_FORMAT_R32G32B32A32_SFLOAT}
+    };
+    const uint32_t *type = get_spirv_declaration(module, typeId, 0);
+    uint32_t componentCount = 1;
+
+    if (type && (type[0] & 0xFFFF) == SPV_OP_TYPE_VECTOR)
+    {
+        componentCount = type[3];
+        type = get_spirv_declaration(module, type[2], 0);
+    }
+
+    if (type == NULL || componentCount < 1 || componentCount > 4)
+    {
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    switch (type[0] & 0xFFFF)
+    {
+    case SPV_OP_TYPE_INT:
+        return type[2] == 32 ? formats[componentCount - 1][type[3] ? 1 : 0] : VK_FORMAT_UNDEFINED;
+    case SPV_OP_TYPE_FLOAT:
+        return type[2] == 32 ? formats[componentCount - 1][2] : VK_FORMAT_UNDEFINED;
+    default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
+static int get_spirv_descriptor_type(const MySpirvModule *module, uint32_t storageClass, uint32_t typeId,
+    MyShaderBinding *binding)
+{
+    const uint32_t *type = get_spirv_declaration(module, typeId, 0);
+
+    // Arrays of descriptors, a runtime array counts as one descriptor
+    binding->count = 1;
+    if (type && (type[0] & 0xFFFF) == SPV_OP_TYPE_ARRAY)
+    {
+        binding->count = get_spirv_array_length(module, type[3]);
+        typeId = type[2];
+    }
+    else if (type && (type[0] & 0xFFFF) == SPV_OP_TYPE_RUNTIME_ARRAY)
+    {
+        typeId = type[2];
+    }
+
+    if ((type = get_spirv_declaration(module, typeId, 0)) == NULL)
+    {
+        return VK_FALSE;
+    }
+
+    switch (storageClass)
+    {
+    case SPV_STORAGE_UNIFORM:
+        // Storage buffers before SPIR-V 1.3 are uniform blocks decorated with BufferBlock
+        binding->type = module->ids[typeId].bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return VK_TRUE;
+    case SPV_STORAGE_STORAGE_BUFFER:
+        binding->type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        return VK_TRUE;
+    default:
+        break;
+    }
+
+    switch (type[0] & 0xFFFF)
+    {
+    case SPV_OP_TYPE_SAMPLER:
+        binding->type = VK_DESCRIPTOR_TYPE_SAMPLER;
+        return VK_TRUE;
+    case SPV_OP_TYPE_SAMPLED_IMAGE:
+        binding->type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        return VK_TRUE;
+    case SPV_OP_TYPE_IMAGE:
+        // Sampled 1 is used with a sampler, 2 is a storage image
+        if (type[3] == SPV_DIM_SUBPASS_DATA)
+        {
+            binding->type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        }
+        else if (type[3] == SPV_DIM_BUFFER)
+        {
+            binding->type = type[7] == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        }
+        else
+        {
+            binding->type = type[7] == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+        return VK_TRUE;
+    default:
+        return VK_FALSE;
+    }
+}
+
+static int reflect_spirv_variable(const char *name, const MySpirvModule *module, uint32_t variableId,
+    MyShaderReflection *reflection)
+{
+    const MySpirvId *variable = &module->ids[variableId];
+    const uint32_t *pointer = get_spirv_declaration(module, variable->instruction[1], SPV_OP_TYPE_POINTER);
+    const uint32_t *type;
+    MyShaderBinding *binding;
+    MyShaderVertexInput *input;
+    uint32_t offset = UINT32_MAX;
+
+    if (pointer == NULL)
+    {
+        fprintf(stderr, "Invalid SPIR-V %s: variable %u is not a pointer\n", name, variableId);
+        return VK_FALSE;
+    }
+
+    switch (variable->instruction[3])
+    {
+    case SPV_STORAGE_PUSH_CONSTANT:
+        if ((type = get_spirv_declaration(module, pointer[3], SPV_OP_TYPE_STRUCT)) == NULL)
+        {
+            fprintf(stderr, "Invalid SPIR-V %s: push constant block %u is not a struct\n", name, variableId);
+            return VK_FALSE;
+        }
+
+        // The range starts at the first member, blocks of several shaders can share one push constant range
+        for (uint32_t i = 0; i < (type[0] >> 16) - 2; i++)
+        {
+            uint32_t memberOffset = get_spirv_member_decoration(module, pointer[3], i, SPV_DECORATION_OFFSET);
+            offset = memberOffset < offset ? memberOffset : offset;
+        }
+
+        reflection->pushConstantOffset = offset == UINT32_MAX ? 0 : offset;
+        reflection->pushConstantSize = get_spirv_type_size(module, pointer[3], 0, 0) - reflection->pushConstantOffset;
+        return VK_TRUE;
+
+    case SPV_STORAGE_UNIFORM_CONSTANT:
+    case SPV_STORAGE_UNIFORM:
+    case SPV_STORAGE_STORAGE_BUFFER:
+        if (!variable->hasBinding)
+        {
+            return VK_TRUE;
+        }
+
+        if (reflection->bindingCount == SPIRV_REFLECT_MAX_BINDINGS)
+        {
+            fprintf(stderr, "Shader %s has more than %u descriptor bindings\n", name, SPIRV_REFLECT_MAX_BINDINGS);
+            return VK_FALSE;
+        }
+
+        binding = &reflection->bindings[reflection->bindingCount];
+        binding->set = variable->set;
+        binding->binding = variable->binding;
+        if (!get_spirv_descriptor_type(module, variable->instruction[3], pointer[3], binding))
+        {
+            fprintf(stderr, "Shader %s: unsupported resource type at set %u binding %u\n", name, variable->set,
+                variable->binding);
+            return VK_FALSE;
+        }
+
+        reflection->bindingCount++;
+        return VK_TRUE;
+
+    case SPV_STORAGE_INPUT:
+        // Vertex attributes only, the inputs of the other stages are outputs of the previous one
+        if (reflection->stage != VK_SHADER_STAGE_VERTEX_BIT || variable->builtIn || !variable->hasLocation)
+        {
+            return VK_TRUE;
+        }
+
+        if (reflection->vertexInputCount == SPIRV_REFLECT_MAX_VERTEX_INPUTS)
+        {
+            fprintf(stderr, "Shader %s has more than %u vertex inputs\n", name, SPIRV_REFLECT_MAX_VERTEX_INPUTS);
+            return VK_FALSE;
+        }
+
+        input = &reflection->vertexInputs[reflection->vertexInputCount++];
+        input->location = variable->location;
+        input->format = get_spirv_vertex_input_format(module, pointer[3]);
+        return VK_TRUE;
+
+    default:
+        return VK_TRUE;
+    }
+}
+
+static int reflect_spirv_spec_constant(const char *name, const MySpirvModule *module, uint32_t constantId,
+    MyShaderReflection *reflection)
+{
+    const uint32_t *constant = module->ids[constantId].instruction;
+    MyShaderSpecConstant *specConstant;
+
+    if (reflection->specConstantCount == SPIRV_REFLECT_MAX_SPEC_CONSTANTS)
+    {
+        fprintf(stderr, "Shader %s has more than %u specialization constants\n", name, SPIRV_REFLECT_MAX_SPEC_CONSTANTS);
+        return VK_FALSE;
+    }
+
+    specConstant = &reflection->specConstants[reflection->specConstantCount++];
+    specConstant->constantId = module->ids[constantId].specId;
+    switch (constant[0] & 0xFFFF)
+    {
+    case SPV_OP_SPEC_CONSTANT_TRUE:
+        specConstant->size = sizeof(VkBool32);
+        specConstant->defaultValue = VK_TRUE;
+        break;
+    case SPV_OP_SPEC_CONSTANT_FALSE:
+        specConstant->size = sizeof(VkBool32);
+        specConstant->defaultValue = VK_FALSE;
+        break;
+    default:
+        // 64 bit literals take two words, low word first
+        specConstant->size = (constant[0] >> 16) > 4 ? sizeof(uint64_t) : sizeof(uint32_t);
+        specConstant->defaultValue = constant[3];
+        if (specConstant->size == sizeof(uint64_t))
+        {
+            specConstant->defaultValue |= (uint64_t)constant[4] << 32;
+        }
+        break;
+    }
+
+    return VK_TRUE;
+}
+
+static VkShaderStageFlagBits get_spirv_execution_model_stage(uint32_t executionModel)
+{
+    switch (executionModel)
+    {
+    case 0:
+        return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1:
+        return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2:
+        return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3:
+        return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4:
+        return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5:
+        return VK_SHADER_STAGE_COMPUTE_BIT;
+    default:
+        return 0;
+    }
+}
+
+// Pass over the declarations, the ids of types, constants and variables point to their instruction
+static int parse_spirv_declarations(const char *name, MySpirvModule *module, uint32_t wordCount,
+    MyShaderReflection *reflection)
+{
+    const uint32_t *instruction;
+    uint32_t length, opcode, resultId;
+
+    for (uint32_t offset = SPIRV_HEADER_WORDS; offset < wordCount; offset += length)
+    {
+        instruction = module->code + offset;
+        length = instruction[0] >> 16;
+        opcode = instruction[0] & 0xFFFF;
+        if (length == 0 || length > wordCount - offset || length < get_spirv_min_length(opcode))
+        {
+            fprintf(stderr, "Invalid SPIR-V %s: truncated instruction at word %u\n", name, offset);
+            return VK_FALSE;
+        }
+
+        module->declarationWords = offset + length;
+        switch (opcode)
+        {
+        case SPV_OP_FUNCTION:
+            module->declarationWords = offset;
+            return VK_TRUE;
+        case SPV_OP_ENTRY_POINT:
+            // Modules compiled by glslc have a single entry point
+            if (reflection->stage == 0)
+            {
+                reflection->stage = get_spirv_execution_model_stage(instruction[1]);
+            }
+            continue;
+        case SPV_OP_DECORATE:
+            if (instruction[1] < module->bound)
+            {
+                decorate_spirv_id(&module->ids[instruction[1]], instruction[2], length > 3 ? instruction[3] : 0);
+            }
+            continue;
+        case SPV_OP_CONSTANT:
+        case SPV_OP_SPEC_CONSTANT_TRUE:
+        case SPV_OP_SPEC_CONSTANT_FALSE:
+        case SPV_OP_SPEC_CONSTANT:
+        case SPV_OP_VARIABLE:
+            resultId = instruction[2];
+            break;
+        default:
+            if (opcode < SPV_OP_TYPE_VOID || opcode > SPV_OP_TYPE_POINTER)
+            {
+                continue;
+            }
+            resultId = instruction[1];
+            break;
+        }
+
+        if (resultId >= module->bound)
+        {
+            fprintf(stderr, "Invalid SPIR-V %s: id %u out of bound %u\n", name, resultId, module->bound);
+            return VK_FALSE;
+        }
+
+        module->ids[resultId].instruction = instruction;
+    }
+
+    return VK_TRUE;
+}
+
+int reflect_spirv_code(const char *name, const uint32_t *code, size_t size, MyShaderReflection *reflection)
+{
+    MySpirvModule module = {0};
+    const uint32_t *instruction;
+    int reflected;
+
+    memset(reflection, 0, sizeof(MyShaderReflection));
+    if (!validate_spirv_code(name, code, size))
+    {
+        return VK_FALSE;
+    }
+
+    module.code = code;
+    module.bound = code[3];
+    if ((module.ids = calloc(module.bound, sizeof(MySpirvId))) == NULL)
+    {
+        fprintf(stderr, "Failed to allocate the ids of %s\n", name);
+        return VK_FALSE;
+    }
+
+    reflected = parse_spirv_declarations(name, &module, (uint32_t)(size / sizeof(uint32_t)), reflection);
+    if (reflected && reflection->stage == 0)
+    {
+        fprintf(stderr, "Shader %s has no graphics or compute entry point\n", name);
+        reflected = VK_FALSE;
+    }
+
+    for (uint32_t i = 0; i < module.bound && reflected; i++)
+    {
+        if ((instruction = module.ids[i].instruction) == NULL)
+        {
+            continue;
+        }
+
+        if ((instruction[0] & 0xFFFF) == SPV_OP_VARIABLE)
+        {
+            reflected = reflect_spirv_variable(name, &module, i, reflection);
+        }
+        else if (module.ids[i].hasSpecId && (instruction[0] & 0xFFFF) >= SPV_OP_SPEC_CONSTANT_TRUE &&
+            (instruction[0] & 0xFFFF) <= SPV_OP_SPEC_CONSTANT)
+        {
+            reflected = reflect_spirv_spec_constant(name, &module, i, reflection);
+        }
+    }
+
+    free(module.ids);
+    return reflected;
+}
+
+int reflect_vulkan_shader(const char *name, MyShaderReflection *reflection)
+{
+    MyMappedFile file = {0};
+    int reflected;
+
+    if (!get_vulkan_shader_code(name, &file))
+    {
+        return VK_FALSE;
+    }
+
+    reflected = reflect_spirv_code(name, file.data, file.size, reflection);
+    unmap_file_from_memory(&file);
+    return reflected;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.h"
+
+#define SPIRV_REFLECT_MAX_BINDINGS          16
+#define SPIRV_REFLECT_MAX_VERTEX_INPUTS     16
+#define SPIRV_REFLECT_MAX_SPEC_CONSTANTS    16
+
+typedef struct MyShaderBinding
+{
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t count; // array size, 1 for runtime arrays
+} MyShaderBinding;
+
+typedef struct MyShaderVertexInput
+{
+    uint32_t location;
+    VkFormat format; // 32 bit scalars and vectors, VK_FORMAT_UNDEFINED otherwise
+} MyShaderVertexInput;
+
+typedef struct MyShaderSpecConstant
+{
+    uint32_t constantId;
+    uint32_t size; // 4 for bool and 32 bit types, 8 for 64 bit types
+    uint64_t defaultValue;
+} MyShaderSpecConstant;
+
+// Interface of a SPIR-V module entry point
+typedef struct MyShaderReflection
+{
+    VkShaderStageFlagBits stage;
+    uint32_t pushConstantOffset;
+    uint32_t pushConstantSize; // 0 if the shader has no push constant block
+    MyShaderBinding bindings[SPIRV_REFLECT_MAX_BINDINGS];
+    uint32_t bindingCount;
+    MyShaderVertexInput vertexInputs[SPIRV_REFLECT_MAX_VERTEX_INPUTS]; // vertex shaders only, built-ins excluded
+    uint32_t vertexInputCount;
+    MyShaderSpecConstant specConstants[SPIRV_REFLECT_MAX_SPEC_CONSTANTS];
+    uint32_t specConstantCount;
+} MyShaderReflection;
+
+// Parses the declarations of a validated SPIR-V module, the function bodies are skipped
+int reflect_spirv_code(const char *name, const uint32_t *code, size_t size, MyShaderReflection *reflection);
+// Reflects the shader from the registry, see get_vulkan_shader_code
+int reflect_vulkan_shader(const char *name, MyShaderReflection *reflection);
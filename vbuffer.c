@@ -1,12 +1,18 @@
 #include "vbuffer.h"
+#include "vmemory.h"
 
 #include <string.h>
 
-VBuffer create_vulkan_buffer(const MyRenderContext *context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) 
+#define UPLOAD_POLICY_ENV "VK_BEGINNER_UPLOAD_POLICY"
+
+VBuffer create_vulkan_buffer(MyRenderContext *context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) 
 {
     VkResult r;
     VkBufferCreateInfo bufferInfo = {0};
-    VkMemoryAllocateInfo allocInfo = {0};
+    VkBufferMemoryRequirementsInfo2 memRequirementsInfo = {0};
+    VkMemoryRequirements2 memRequirements = {0};
+    VkMemoryDedicatedRequirements dedicatedRequirements = {0};
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {0};
     VBuffer buffer = {0};
     
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -14,117 +20,572 @@ VBuffer create_vulkan_buffer(const MyRenderContext *context, VkDeviceSize size,
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    CHECK_VK(vkCreateBuffer(context->logicalDevice, &bufferInfo, NULL, &buffer.buffer));
+    CHECK_VK(vkCreateBuffer(context->logicalDevice, &bufferInfo, context->allocationCallbacks, &buffer.buffer));
+
+    memRequirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    memRequirementsInfo.buffer = buffer.buffer;
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    memRequirements.pNext = &dedicatedRequirements;
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(context->logicalDevice, buffer.buffer, &memRequirements);
+    vkGetBufferMemoryRequirements2(context->logicalDevice, &memRequirementsInfo, &memRequirements);
 
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = get_vulkan_memory_type_index(context, memRequirements.memoryTypeBits, properties);
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = buffer.buffer;
 
-    if (allocInfo.memoryTypeIndex == UINT32_MAX)
+    // Buffers are sub-allocated from shared memory blocks instead of owning a VkDeviceMemory each, unless the driver
+    // asks for a dedicated allocation or the buffer is large
+    if (!allocate_vulkan_memory(context, &memRequirements.memoryRequirements, properties, VK_TRUE, 
+        use_vulkan_dedicated_memory(context, &dedicatedRequirements, size) ? &dedicatedInfo : NULL, &buffer.allocation))
     {
-        vkDestroyBuffer(context->logicalDevice, buffer.buffer, NULL);
+        vkDestroyBuffer(context->logicalDevice, buffer.buffer, context->allocationCallbacks);
         buffer.buffer = VK_NULL_HANDLE;
         return buffer;
     }
 
-    CHECK_VK(vkAllocateMemory(context->logicalDevice, &allocInfo, NULL, &buffer.memory));
-    CHECK_VK(vkBindBufferMemory(context->logicalDevice, buffer.buffer, buffer.memory, 0));
+    CHECK_VK(vkBindBufferMemory(context->logicalDevice, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset));
     
     buffer.size = size;
     return buffer;
 }
 
-void copy_vulkan_buffer(const MyRenderContext *context, VBuffer srcBuffer, VBuffer dstBuffer, VkDeviceSize size) 
-{   
+void wait_vulkan_transfer_timeline(MyRenderContext *context, uint64_t value)
+{
+    VkResult r;
+    VkSemaphoreWaitInfo waitInfo = {0};
+
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &context->transferTimeline;
+    waitInfo.pValues = &value;
+
+    CHECK_VK(vkWaitSemaphores(context->logicalDevice, &waitInfo, UINT64_MAX));
+}
+
+static void release_upload_batch(MyRenderContext *context, MyUploadBatch *batch)
+{
+    vkFreeCommandBuffers(context->logicalDevice, context->transferCommandPool, 1, &batch->commandBuffer);
+
+    for (uint32_t i = 0; i < batch->stagingBufferCount; i++)
+    {
+        destroy_vulkan_buffer(context, batch->stagingBuffers[i]);
+    }
+
+    free(batch->stagingBuffers);
+    free(batch->releaseBarriers);
+    memset(batch, 0, sizeof(MyUploadBatch));
+}
+
+void poll_vulkan_transfers(MyRenderContext *context)
+{
+    VkResult r;
+    MyStagingRing *ring = &context->stagingRing;
+    uint64_t completedValue = 0;
+
+    CHECK_VK(vkGetSemaphoreCounterValue(context->logicalDevice, context->transferTimeline, &completedValue));
+    context->transferCompletedValue = completedValue;
+
+    while (context->pendingTransferCount > 0 && 
+        context->pendingTransfers[context->firstPendingTransfer].timelineValue <= completedValue)
+    {
+        release_upload_batch(context, &context->pendingTransfers[context->firstPendingTransfer].batch);
+        context->firstPendingTransfer = (context->firstPendingTransfer + 1) % MAX_PENDING_TRANSFERS;
+        context->pendingTransferCount--;
+    }
+
+    while (ring->regionCount > 0 && ring->regions[ring->firstRegion].timelineValue <= completedValue)
+    {
+        ring->tail = ring->regions[ring->firstRegion].end;
+        ring->firstRegion = (ring->firstRegion + 1) % STAGING_RING_MAX_REGIONS;
+        ring->regionCount--;
+    }
+
+    // Nothing is in flight, restart from the beginning of the buffer to avoid needless wrapping
+    if (ring->regionCount == 0)
+    {
+        ring->head = ring->tail = ALIGN_UP(ring->head, ring->buffer.size);
+    }
+}
+
+// VK_BEGINNER_UPLOAD_POLICY: auto, stage to always copy through the staging ring, direct to write straight into
+// host visible device local memory whenever the device has it
+static void init_vulkan_upload_policy(MyRenderContext *context)
+{
+    const char *setting = getenv(UPLOAD_POLICY_ENV);
+
+    context->uploadPolicy = UPLOAD_POLICY_AUTO;
+    if (!setting || !setting[0] || strcmp(setting, "auto") == 0)
+    {
+        return;
+    }
+
+    if (strcmp(setting, "stage") == 0)
+    {
+        context->uploadPolicy = UPLOAD_POLICY_ALWAYS_STAGE;
+    }
+    else if (strcmp(setting, "direct") == 0)
+    {
+        context->uploadPolicy = UPLOAD_POLICY_PREFER_DIRECT;
+    }
+    else
+    {
+        fprintf(stderr, "Ignoring %s=%s, expected auto, stage or direct\n", UPLOAD_POLICY_ENV, setting);
+        return;
+    }
+
+    printf("Upload policy: %s\n", setting);
+}
+
+void create_vulkan_staging_ring(MyRenderContext *context)
+{
+    init_vulkan_upload_policy(context);
+
+    memset(&context->stagingRing, 0, sizeof(MyStagingRing));
+    context->stagingRing.buffer = create_vulkan_buffer(context, STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    if (!context->stagingRing.buffer.buffer)
+    {
+        fprintf(stderr, "Failed to create staging ring buffer\n");
+        exit(1);
+    }
+
+    context->transferCompletedValue = 0;
+    context->firstPendingTransfer = 0;
+    context->pendingTransferCount = 0;
+    context->uploadBatchActive = VK_FALSE;
+}
+
+void destroy_vulkan_staging_ring(MyRenderContext *context)
+{
+    SDL_assert(!context->uploadBatchActive);
+    // Release the command buffers and temporary staging buffers of all submitted batches
+    wait_vulkan_transfer_timeline(context, context->transferTimelineValue);
+    poll_vulkan_transfers(context);
+
+    destroy_vulkan_buffer(context, context->stagingRing.buffer);
+    memset(&context->stagingRing, 0, sizeof(MyStagingRing));
+}
+
+static VkDeviceSize get_staging_size(MyRenderContext *context, VkDeviceSize size)
+{
+    return ALIGN_UP(size, MAX(context->supportedFeatures.limits.optimalBufferCopyOffsetAlignment, 16));
+}
+
+static int allocate_staging_memory(MyRenderContext *context, VkDeviceSize size, uint64_t timelineValue, VkDeviceSize *offset)
+{
+    MyStagingRing *ring = &context->stagingRing;
+
+    size = get_staging_size(context, size);
+    if (size > ring->buffer.size)
+    {
+        return VK_FALSE;
+    }
+
+    for (;;)
+    {
+        VkDeviceSize position, skip;
+
+        poll_vulkan_transfers(context);
+        position = ring->head % ring->buffer.size;
+        // Allocations never wrap around the end of the buffer, the rest of the buffer is skipped instead
+        skip = position + size > ring->buffer.size ? ring->buffer.size - position : 0;
+
+        if (ring->head + skip + size - ring->tail <= ring->buffer.size && ring->regionCount < STAGING_RING_MAX_REGIONS)
+        {
+            uint32_t lastRegion = (ring->firstRegion + ring->regionCount + STAGING_RING_MAX_REGIONS - 1) % STAGING_RING_MAX_REGIONS;
+
+            ring->head += skip;
+            *offset = ring->head % ring->buffer.size;
+            ring->head += size;
+
+            if (ring->regionCount > 0 && ring->regions[lastRegion].timelineValue == timelineValue)
+            {
+                ring->regions[lastRegion].end = ring->head;
+            }
+            else
+            {
+                lastRegion = (ring->firstRegion + ring->regionCount) % STAGING_RING_MAX_REGIONS;
+                ring->regions[lastRegion].end = ring->head;
+                ring->regions[lastRegion].timelineValue = timelineValue;
+                ring->regionCount++;
+            }
+
+            return VK_TRUE;
+        }
+
+        // The ring is full of the current batch data which is not submitted yet, waiting would never end
+        SDL_assert(ring->regionCount > 0);
+        if (ring->regions[ring->firstRegion].timelineValue > context->transferTimelineValue)
+        {
+            return VK_FALSE;
+        }
+
+        // Wait for the oldest upload to complete
+        wait_vulkan_transfer_timeline(context, ring->regions[ring->firstRegion].timelineValue);
+    }
+}
+
+void begin_vulkan_upload_batch(MyRenderContext *context, MyUploadBatch *batch)
+{
     VkResult r;
     VkCommandBufferAllocateInfo allocInfo = {0};
-    VkCommandBuffer commandBuffer;
     VkCommandBufferBeginInfo beginInfo = {0};
-    VkBufferCopy copyRegion = {0};
-    VkSubmitInfo submitInfo = {0};
 
     SDL_assert(context->transferCommandPool);
-    SDL_assert(context->transferQueue.queue);
+    // Staging memory is tagged with the next timeline value, so only one batch may be recorded at a time
+    SDL_assert(!context->uploadBatchActive);
+
+    memset(batch, 0, sizeof(MyUploadBatch));
+    context->uploadBatchActive = VK_TRUE;
 
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandPool = context->transferCommandPool;
     allocInfo.commandBufferCount = 1;
 
-    CHECK_VK(vkAllocateCommandBuffers(context->logicalDevice, &allocInfo, &commandBuffer));
+    CHECK_VK(vkAllocateCommandBuffers(context->logicalDevice, &allocInfo, &batch->commandBuffer));
 
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    CHECK_VK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    CHECK_VK(vkBeginCommandBuffer(batch->commandBuffer, &beginInfo));
+}
+
+uint64_t flush_vulkan_upload_batch(MyRenderContext *context, MyUploadBatch *batch)
+{
+    VkResult r;
+    VkSubmitInfo2 submitInfo = {0};
+    VkCommandBufferSubmitInfo commandBufferInfo = {0};
+    VkSemaphoreSubmitInfo signalSemaphoreInfo = {0};
+    MyPendingTransfer *pendingTransfer;
+
+    SDL_assert(context->uploadBatchActive);
+    SDL_assert(context->transferQueue.queue);
+
+    if (batch->releaseBarrierCount > 0)
+    {
+        VkDependencyInfo dependencyInfo = {0};
 
+        // Release the uploaded buffers to the graphics queue family, the matching acquire is done by acquire_vulkan_buffer
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.bufferMemoryBarrierCount = batch->releaseBarrierCount;
+        dependencyInfo.pBufferMemoryBarriers = batch->releaseBarriers;
+        vkCmdPipelineBarrier2(batch->commandBuffer, &dependencyInfo);
+    }
+
+    CHECK_VK(vkEndCommandBuffer(batch->commandBuffer));
+    context->uploadBatchActive = VK_FALSE;
+
+    // Nothing was recorded, the previous timeline value covers all the uploads made so far
+    if (batch->copyCount == 0)
+    {
+        release_upload_batch(context, batch);
+        return context->transferTimelineValue;
+    }
+
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    commandBufferInfo.commandBuffer = batch->commandBuffer;
+
+    // Signal the next transfer timeline value, staging memory of the batch is reclaimed by it
+    signalSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signalSemaphoreInfo.semaphore = context->transferTimeline;
+    signalSemaphoreInfo.value = ++context->transferTimelineValue;
+    signalSemaphoreInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    submitInfo.signalSemaphoreInfoCount = 1;
+    submitInfo.pSignalSemaphoreInfos = &signalSemaphoreInfo;
+
+    CHECK_VK(vkQueueSubmit2(context->transferQueue.queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    // The command buffer and temporary staging buffers must live until the GPU is done with them
+    poll_vulkan_transfers(context);
+    if (context->pendingTransferCount == MAX_PENDING_TRANSFERS)
+    {
+        wait_vulkan_transfer_timeline(context, context->pendingTransfers[context->firstPendingTransfer].timelineValue);
+        poll_vulkan_transfers(context);
+    }
+
+    pendingTransfer = context->pendingTransfers + 
+        (context->firstPendingTransfer + context->pendingTransferCount) % MAX_PENDING_TRANSFERS;
+    pendingTransfer->batch = *batch;
+    pendingTransfer->timelineValue = context->transferTimelineValue;
+    context->pendingTransferCount++;
+
+    memset(batch, 0, sizeof(MyUploadBatch));
+    return context->transferTimelineValue;
+}
+
+void record_vulkan_buffer_copy(MyRenderContext *context, MyUploadBatch *batch, VBuffer srcBuffer, VkDeviceSize srcOffset, 
+    VBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+    VkBufferCopy copyRegion = {0};
+
+    SDL_assert(context->uploadBatchActive && batch->commandBuffer);
+
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer.buffer, dstBuffer.buffer, 1, &copyRegion);
+    vkCmdCopyBuffer(batch->commandBuffer, srcBuffer.buffer, dstBuffer.buffer, 1, &copyRegion);
+    batch->copyCount++;
+}
 
-    CHECK_VK(vkEndCommandBuffer(commandBuffer));
+static int use_direct_upload(const MyRenderContext *context, VkDeviceSize size)
+{
+    uint32_t heapIndex = context->memoryAllocator.directUploadHeapIndex;
+    VkDeviceSize headroom;
 
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    if (heapIndex == UINT32_MAX || context->uploadPolicy == UPLOAD_POLICY_ALWAYS_STAGE)
+    {
+        return VK_FALSE;
+    }
 
-    CHECK_VK(vkQueueSubmit(context->transferQueue.queue, 1, &submitInfo, VK_NULL_HANDLE));
-    CHECK_VK(vkQueueWaitIdle(context->transferQueue.queue));
+    // On unified memory staging would only copy inside the same memory
+    if (context->uploadPolicy == UPLOAD_POLICY_PREFER_DIRECT || 
+        context->supportedFeatures.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+    {
+        return VK_TRUE;
+    }
 
-    vkFreeCommandBuffers(context->logicalDevice, context->transferCommandPool, 1, &commandBuffer);
+    // Writes over PCIe are cheap for small buffers only, large ones are copied faster by the transfer queue.
+    // Keep most of the heap free, the small BAR window is shared with the driver.
+    headroom = get_vulkan_memory_heap_headroom(context, heapIndex);
+    return size <= DIRECT_UPLOAD_MAX_SIZE && size <= headroom / 8;
 }
 
-VBuffer create_and_upload_vulkan_buffer(const MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags usage)
+VBuffer upload_vulkan_buffer(MyRenderContext *context, MyUploadBatch *batch, const void *bufferData, VkDeviceSize bufferSize, 
+    VkBufferUsageFlags usage)
 {
-    VkResult r;
-    void *data = NULL;
-    VBuffer deviceBuffer;
-    VBuffer stagingBuffer;
+    VBuffer deviceBuffer = {0};
+    VBuffer stagingBuffer = {0};
+    VkDeviceSize stagingOffset = 0;
+    int staged;
 
-    if (context->supportedFeatures.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+    if (use_direct_upload(context, bufferSize))
     {
-        deviceBuffer = stagingBuffer = create_vulkan_buffer(context, bufferSize, usage, 
+        deviceBuffer = create_vulkan_buffer(context, bufferSize, usage, 
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (deviceBuffer.buffer)
+        {
+            // Host visible memory blocks are persistently mapped
+            SDL_assert(deviceBuffer.allocation.mapped);
+            memcpy(deviceBuffer.allocation.mapped, bufferData, (size_t) bufferSize);
+            return deviceBuffer;
+        }
+    }
+
+    // Device local memory may be exhausted, the allocator falls back to system memory before giving up
+    deviceBuffer = create_vulkan_buffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, 
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (!deviceBuffer.buffer)
+    {
+        return deviceBuffer;
     }
 
-    if (!stagingBuffer.buffer)
+    // The batch signals the next transfer timeline value, the staging range is reusable after that
+    staged = allocate_staging_memory(context, bufferSize, context->transferTimelineValue + 1, &stagingOffset);
+    if (!staged && batch->copyCount > 0 && get_staging_size(context, bufferSize) <= context->stagingRing.buffer.size)
+    {
+        // The staging ring is full of this batch, submit what is recorded and continue with a new command buffer
+        flush_vulkan_upload_batch(context, batch);
+        begin_vulkan_upload_batch(context, batch);
+        staged = allocate_staging_memory(context, bufferSize, context->transferTimelineValue + 1, &stagingOffset);
+    }
+
+    if (staged)
+    {
+        stagingBuffer = context->stagingRing.buffer;
+    }
+    else
     {
+        // Upload does not fit the staging ring at all, use a temporary staging buffer released with the batch
         stagingBuffer = create_vulkan_buffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        if (!stagingBuffer.buffer)
+        {
+            destroy_vulkan_buffer(context, deviceBuffer);
+            memset(&deviceBuffer, 0, sizeof(VBuffer));
+            return deviceBuffer;
+        }
+
+        batch->stagingBuffers = realloc(batch->stagingBuffers, sizeof(VBuffer) * (batch->stagingBufferCount + 1));
+        batch->stagingBuffers[batch->stagingBufferCount++] = stagingBuffer;
     }
 
-    CHECK_VK(vkMapMemory(context->logicalDevice, stagingBuffer.memory, 0, stagingBuffer.size, 0, &data));
-    SDL_assert(data);
+    SDL_assert(stagingBuffer.allocation.mapped);
+    memcpy((uint8_t *)stagingBuffer.allocation.mapped + stagingOffset, bufferData, (size_t) bufferSize);
 
-    memcpy(data, bufferData, (size_t) bufferSize);
-    vkUnmapMemory(context->logicalDevice, stagingBuffer.memory);
+    record_vulkan_buffer_copy(context, batch, stagingBuffer, stagingOffset, deviceBuffer, 0, bufferSize);
+    deviceBuffer.uploadTimelineValue = context->transferTimelineValue + 1;
 
-    if (!deviceBuffer.buffer)
+    // Exclusive buffers written by the transfer queue must be handed over to the graphics queue family
+    if (context->transferQueue.familyIndex != context->graphicsQueue.familyIndex)
+    {
+        VkBufferMemoryBarrier2 *releaseBarrier;
+
+        batch->releaseBarriers = realloc(batch->releaseBarriers, sizeof(VkBufferMemoryBarrier2) * (batch->releaseBarrierCount + 1));
+        releaseBarrier = batch->releaseBarriers + batch->releaseBarrierCount++;
+        memset(releaseBarrier, 0, sizeof(VkBufferMemoryBarrier2));
+
+        releaseBarrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        releaseBarrier->srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        releaseBarrier->srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        releaseBarrier->dstStageMask = VK_PIPELINE_STAGE_2_NONE; // ignored for the release operation
+        releaseBarrier->dstAccessMask = VK_ACCESS_2_NONE_KHR;
+        releaseBarrier->srcQueueFamilyIndex = context->transferQueue.familyIndex;
+        releaseBarrier->dstQueueFamilyIndex = context->graphicsQueue.familyIndex;
+        releaseBarrier->buffer = deviceBuffer.buffer;
+        releaseBarrier->offset = 0;
+        releaseBarrier->size = VK_WHOLE_SIZE;
+        deviceBuffer.acquirePending = VK_TRUE;
+    }
+
+    return deviceBuffer;
+}
+
+void acquire_vulkan_buffer(MyRenderContext *context, MyFrameInFlight *frameInFlight, VBuffer *buffer, 
+    VkPipelineStageFlags2 stageMask, VkAccessFlags2 accessMask)
+{
+    if (buffer->acquirePending)
     {
-        deviceBuffer = create_vulkan_buffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, 
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VkBufferMemoryBarrier2 acquireBarrier = {0};
+        VkDependencyInfo dependencyInfo = {0};
+
+        // Acquire part of the queue family ownership transfer, must match the release barrier of the upload batch
+        acquireBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        acquireBarrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE; // ignored for the acquire operation
+        acquireBarrier.srcAccessMask = VK_ACCESS_2_NONE_KHR;
+        acquireBarrier.dstStageMask = stageMask;
+        acquireBarrier.dstAccessMask = accessMask;
+        acquireBarrier.srcQueueFamilyIndex = context->transferQueue.familyIndex;
+        acquireBarrier.dstQueueFamilyIndex = context->graphicsQueue.familyIndex;
+        acquireBarrier.buffer = buffer->buffer;
+        acquireBarrier.offset = 0;
+        acquireBarrier.size = VK_WHOLE_SIZE;
+
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.bufferMemoryBarrierCount = 1;
+        dependencyInfo.pBufferMemoryBarriers = &acquireBarrier;
+        vkCmdPipelineBarrier2(frameInFlight->commandBuffer, &dependencyInfo);
+        buffer->acquirePending = VK_FALSE;
+    }
 
-        copy_vulkan_buffer(context, stagingBuffer, deviceBuffer, bufferSize);
-        destroy_vulkan_buffer(context, stagingBuffer);
+    // Upload may be still in flight, the frame submit waits for it at the first stage reading the buffer
+    if (buffer->uploadTimelineValue > context->transferCompletedValue)
+    {
+        frameInFlight->transferWaitValue = MAX(frameInFlight->transferWaitValue, buffer->uploadTimelineValue);
+        frameInFlight->transferWaitStages |= stageMask;
+    }
+    else
+    {
+        buffer->uploadTimelineValue = 0;
     }
+}
+
+void copy_vulkan_buffer(MyRenderContext *context, VBuffer srcBuffer, VkDeviceSize srcOffset, VBuffer dstBuffer, 
+    VkDeviceSize dstOffset, VkDeviceSize size) 
+{
+    MyUploadBatch batch;
+
+    begin_vulkan_upload_batch(context, &batch);
+    record_vulkan_buffer_copy(context, &batch, srcBuffer, srcOffset, dstBuffer, dstOffset, size);
+    wait_vulkan_transfer_timeline(context, flush_vulkan_upload_batch(context, &batch));
+}
+
+VBuffer create_and_upload_vulkan_buffer(MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags usage)
+{
+    MyUploadBatch batch;
+    VBuffer deviceBuffer;
+
+    begin_vulkan_upload_batch(context, &batch);
+    deviceBuffer = upload_vulkan_buffer(context, &batch, bufferData, bufferSize, usage);
+    wait_vulkan_transfer_timeline(context, flush_vulkan_upload_batch(context, &batch));
 
     return deviceBuffer;
 }
 
-void destroy_vulkan_buffer(const MyRenderContext *context, VBuffer buffer) 
+void create_vulkan_transient_buffer(MyRenderContext *context)
+{
+    MyTransientBuffer *transient = &context->transientBuffer;
+    VkDeviceSize size = TRANSIENT_FRAME_SIZE * MAX_FRAMES_IN_FLIGHT;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+
+    memset(transient, 0, sizeof(MyTransientBuffer));
+    transient->alignment = MAX(context->supportedFeatures.limits.minUniformBufferOffsetAlignment, 
+        context->supportedFeatures.limits.minStorageBufferOffsetAlignment);
+    transient->alignment = MAX(transient->alignment, 16);
+
+    // GPU reads the data directly, so prefer the device local memory if it is host visible
+    if (context->memoryAllocator.directUploadHeapIndex != UINT32_MAX)
+    {
+        transient->buffer = create_vulkan_buffer(context, size, usage, 
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    if (!transient->buffer.buffer)
+    {
+        transient->buffer = create_vulkan_buffer(context, size, usage, 
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
+    if (!transient->buffer.buffer)
+    {
+        fprintf(stderr, "Failed to create transient buffer\n");
+        exit(1);
+    }
+}
+
+void destroy_vulkan_transient_buffer(MyRenderContext *context)
+{
+    destroy_vulkan_buffer(context, context->transientBuffer.buffer);
+    memset(&context->transientBuffer, 0, sizeof(MyTransientBuffer));
+}
+
+void reset_vulkan_transient_buffer(MyRenderContext *context, uint32_t frameInFlightIndex)
+{
+    context->transientBuffer.heads[frameInFlightIndex] = 0;
+}
+
+int allocate_vulkan_transient(MyRenderContext *context, VkDeviceSize size, MyTransientAllocation *allocation)
+{
+    MyTransientBuffer *transient = &context->transientBuffer;
+    uint32_t frameInFlightIndex = context->frameStats.frameInFlightIndex;
+    VkDeviceSize offset = ALIGN_UP(transient->heads[frameInFlightIndex], transient->alignment);
+
+    if (offset + size > TRANSIENT_FRAME_SIZE)
+    {
+        return VK_FALSE;
+    }
+
+    transient->heads[frameInFlightIndex] = offset + size;
+    offset += frameInFlightIndex * TRANSIENT_FRAME_SIZE;
+
+    allocation->buffer = transient->buffer.buffer;
+    allocation->offset = offset;
+    allocation->mapped = (uint8_t *)transient->buffer.allocation.mapped + offset;
+    return VK_TRUE;
+}
+
+void destroy_vulkan_buffer(MyRenderContext *context, VBuffer buffer) 
 {
-    vkDestroyBuffer(context->logicalDevice, buffer.buffer, NULL);
-    vkFreeMemory(context->logicalDevice, buffer.memory, NULL);
+    vkDestroyBuffer(context->logicalDevice, buffer.buffer, context->allocationCallbacks);
+    // Return the range to its memory block, the block itself stays alive for the next buffers
+    free_vulkan_memory(context, &buffer.allocation);
 }
 
-VBuffer create_and_upload_vulkan_vbo(const MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize)
+VBuffer create_and_upload_vulkan_vbo(MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize)
 {
     return create_and_upload_vulkan_buffer(context, bufferData, bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
 }
 
-VBuffer create_and_upload_vulkan_ibo(const MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize)
+VBuffer create_and_upload_vulkan_ibo(MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize)
 {
     return create_and_upload_vulkan_buffer(context, bufferData, bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 }
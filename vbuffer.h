@@ -2,10 +2,38 @@
 
 #include "common.h"
 
-VBuffer create_vulkan_buffer(const MyRenderContext *context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
-void copy_vulkan_buffer(const MyRenderContext *context, VBuffer srcBuffer, VBuffer dstBuffer, VkDeviceSize size);
-VBuffer create_and_upload_vulkan_buffer(const MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags usage);
-void destroy_vulkan_buffer(const MyRenderContext *context, VBuffer buffer);
+VBuffer create_vulkan_buffer(MyRenderContext *context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+void copy_vulkan_buffer(MyRenderContext *context, VBuffer srcBuffer, VkDeviceSize srcOffset, VBuffer dstBuffer, 
+    VkDeviceSize dstOffset, VkDeviceSize size);
+VBuffer create_and_upload_vulkan_buffer(MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags usage);
+void destroy_vulkan_buffer(MyRenderContext *context, VBuffer buffer);
 
-VBuffer create_and_upload_vulkan_vbo(const MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize);
-VBuffer create_and_upload_vulkan_ibo(const MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize);
+void create_vulkan_staging_ring(MyRenderContext *context);
+void destroy_vulkan_staging_ring(MyRenderContext *context);
+
+// Per frame linear allocator for transient uniform, vertex and instance data. Allocations stay valid until the frame
+// in flight is reused, no Vulkan calls are made. Memory is host coherent, no flushes are needed.
+void create_vulkan_transient_buffer(MyRenderContext *context);
+void destroy_vulkan_transient_buffer(MyRenderContext *context);
+void reset_vulkan_transient_buffer(MyRenderContext *context, uint32_t frameInFlightIndex);
+int allocate_vulkan_transient(MyRenderContext *context, VkDeviceSize size, MyTransientAllocation *allocation);
+
+// Upload batch, all copies are recorded into one command buffer and submitted by a single flush.
+// Flush returns the transfer timeline value to wait for before the uploaded buffers are used.
+void begin_vulkan_upload_batch(MyRenderContext *context, MyUploadBatch *batch);
+uint64_t flush_vulkan_upload_batch(MyRenderContext *context, MyUploadBatch *batch);
+void record_vulkan_buffer_copy(MyRenderContext *context, MyUploadBatch *batch, VBuffer srcBuffer, VkDeviceSize srcOffset, 
+    VBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+// Returns a buffer with VK_NULL_HANDLE on out of memory
+VBuffer upload_vulkan_buffer(MyRenderContext *context, MyUploadBatch *batch, const void *bufferData, VkDeviceSize bufferSize, 
+    VkBufferUsageFlags usage);
+void wait_vulkan_transfer_timeline(MyRenderContext *context, uint64_t value);
+// Releases the resources of completed upload batches
+void poll_vulkan_transfers(MyRenderContext *context);
+// Must be called for every uploaded buffer used by the frame, outside of the render pass. Acquires the queue family
+// ownership once and makes the frame submit wait for the upload if it is still in flight.
+void acquire_vulkan_buffer(MyRenderContext *context, MyFrameInFlight *frameInFlight, VBuffer *buffer, 
+    VkPipelineStageFlags2 stageMask, VkAccessFlags2 accessMask);
+
+VBuffer create_and_upload_vulkan_vbo(MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize);
+VBuffer create_and_upload_vulkan_ibo(MyRenderContext *context, const void *bufferData, VkDeviceSize bufferSize);
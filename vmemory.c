@@ -0,0 +1,482 @@
+#include "vmemory.h"
+
+#include <string.h>
+
+#define INITIAL_FREE_RANGE_CAPACITY 16
+
+static void insert_free_range(MyMemoryBlock *block, uint32_t index, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (block->freeRangeCount == block->freeRangeCapacity)
+    {
+        block->freeRangeCapacity *= 2;
+        block->freeRanges = realloc(block->freeRanges, sizeof(MyMemoryRange) * block->freeRangeCapacity);
+    }
+
+    memmove(block->freeRanges + index + 1, block->freeRanges + index, sizeof(MyMemoryRange) * (block->freeRangeCount - index));
+    block->freeRanges[index].offset = offset;
+    block->freeRanges[index].size = size;
+    block->freeRangeCount++;
+}
+
+static void remove_free_range(MyMemoryBlock *block, uint32_t index)
+{
+    memmove(block->freeRanges + index, block->freeRanges + index + 1, sizeof(MyMemoryRange) * (block->freeRangeCount - index - 1));
+    block->freeRangeCount--;
+}
+
+static MyMemoryBlock *create_memory_block(MyRenderContext *context, uint32_t memoryTypeIndex, VkDeviceSize size,
+    const VkMemoryDedicatedAllocateInfo *dedicatedInfo)
+{
+    VkResult r;
+    VkMemoryAllocateInfo allocInfo = {0};
+    MyMemoryBlock *block;
+
+    if (context->memoryAllocator.blockCount >= context->supportedFeatures.limits.maxMemoryAllocationCount)
+    {
+        fprintf(stderr, "Device memory allocation count limit reached (%u)\n", context->memoryAllocator.blockCount);
+        return NULL;
+    }
+
+    block = calloc(1, sizeof(MyMemoryBlock));
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+    allocInfo.pNext = dedicatedInfo;
+
+    // Out of memory is not fatal, the caller falls back to another memory type
+    if ((r = vkAllocateMemory(context->logicalDevice, &allocInfo, context->allocationCallbacks, &block->memory)) != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to allocate %llu bytes of memory type %u: %d\n", (unsigned long long)size, memoryTypeIndex, r);
+        free(block);
+        return NULL;
+    }
+
+    // Host visible memory can be mapped only once, so map the whole block and share the pointer between sub-allocations
+    if (context->supportedFeatures.memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        if ((r = vkMapMemory(context->logicalDevice, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped)) != VK_SUCCESS)
+        {
+            fprintf(stderr, "Failed to map memory type %u: %d\n", memoryTypeIndex, r);
+            vkFreeMemory(context->logicalDevice, block->memory, context->allocationCallbacks);
+            free(block);
+            return NULL;
+        }
+    }
+
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->dedicated = dedicatedInfo ? VK_TRUE : VK_FALSE;
+    block->freeRangeCapacity = INITIAL_FREE_RANGE_CAPACITY;
+    block->freeRanges = malloc(sizeof(MyMemoryRange) * block->freeRangeCapacity);
+    block->freeRanges[0].offset = 0;
+    block->freeRanges[0].size = size;
+    block->freeRangeCount = 1;
+
+    block->next = context->memoryAllocator.blocks[memoryTypeIndex];
+    context->memoryAllocator.blocks[memoryTypeIndex] = block;
+    context->memoryAllocator.blockCount++;
+    context->memoryAllocator.dedicatedCount += block->dedicated;
+    context->memoryAllocator.heapBlockBytes[context->supportedFeatures.memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+    update_vulkan_memory_budget(context);
+    return block;
+}
+
+static void destroy_memory_block(MyRenderContext *context, MyMemoryBlock *block)
+{
+    MyMemoryBlock **link = &context->memoryAllocator.blocks[block->memoryTypeIndex];
+
+    while (*link != block)
+    {
+        link = &(*link)->next;
+    }
+
+    *link = block->next;
+    context->memoryAllocator.blockCount--;
+    context->memoryAllocator.dedicatedCount -= block->dedicated;
+    context->memoryAllocator.heapBlockBytes[context->supportedFeatures.memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex] -= block->size;
+
+    // Freeing the memory object implicitly unmaps it
+    vkFreeMemory(context->logicalDevice, block->memory, context->allocationCallbacks);
+    free(block->freeRanges);
+    free(block);
+    update_vulkan_memory_budget(context);
+}
+
+static int allocate_from_memory_block(MyMemoryBlock *block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+    // First fit, the padding in front of the aligned offset stays in the free list
+    for (uint32_t i = 0; i < block->freeRangeCount; i++)
+    {
+        VkDeviceSize rangeOffset = block->freeRanges[i].offset;
+        VkDeviceSize rangeSize = block->freeRanges[i].size;
+        VkDeviceSize alignedOffset = ALIGN_UP(rangeOffset, alignment);
+        VkDeviceSize padding = alignedOffset - rangeOffset;
+        VkDeviceSize tailSize;
+
+        if (padding + size > rangeSize)
+        {
+            continue;
+        }
+
+        tailSize = rangeSize - padding - size;
+        if (padding > 0 && tailSize > 0)
+        {
+            block->freeRanges[i].size = padding;
+            insert_free_range(block, i + 1, alignedOffset + size, tailSize);
+        }
+        else if (padding > 0)
+        {
+            block->freeRanges[i].size = padding;
+        }
+        else if (tailSize > 0)
+        {
+            block->freeRanges[i].offset = alignedOffset + size;
+            block->freeRanges[i].size = tailSize;
+        }
+        else
+        {
+            remove_free_range(block, i);
+        }
+
+        block->allocationCount++;
+        *offset = alignedOffset;
+        return VK_TRUE;
+    }
+
+    return VK_FALSE;
+}
+
+static void release_to_memory_block(MyMemoryBlock *block, VkDeviceSize offset, VkDeviceSize size)
+{
+    uint32_t i = 0;
+    uint8_t mergePrev, mergeNext;
+
+    // Find the first free range located after the released one
+    while (i < block->freeRangeCount && block->freeRanges[i].offset < offset)
+    {
+        i++;
+    }
+
+    mergePrev = i > 0 && block->freeRanges[i - 1].offset + block->freeRanges[i - 1].size == offset;
+    mergeNext = i < block->freeRangeCount && offset + size == block->freeRanges[i].offset;
+
+    if (mergePrev && mergeNext)
+    {
+        block->freeRanges[i - 1].size += size + block->freeRanges[i].size;
+        remove_free_range(block, i);
+    }
+    else if (mergePrev)
+    {
+        block->freeRanges[i - 1].size += size;
+    }
+    else if (mergeNext)
+    {
+        block->freeRanges[i].offset = offset;
+        block->freeRanges[i].size += size;
+    }
+    else
+    {
+        insert_free_range(block, i, offset, size);
+    }
+
+    block->allocationCount--;
+}
+
+static uint32_t count_extra_memory_properties(VkMemoryPropertyFlags flags, VkMemoryPropertyFlags properties)
+{
+    uint32_t count = 0;
+
+    for (flags &= ~properties; flags; flags &= flags - 1)
+    {
+        count++;
+    }
+
+    return count;
+}
+
+void update_vulkan_memory_budget(MyRenderContext *context)
+{
+    MyMemoryAllocator *allocator = &context->memoryAllocator;
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = &context->supportedFeatures.memoryProperties;
+    VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {0};
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {0};
+
+    if (context->supportedFeatures.memoryBudgetSupport)
+    {
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memoryProperties2.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(context->physicalDevice, &memoryProperties2);
+
+        for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++)
+        {
+            allocator->heapBudget[i] = budgetProperties.heapBudget[i];
+            allocator->heapBudgetUsage[i] = budgetProperties.heapUsage[i];
+        }
+
+        return;
+    }
+
+    // No budget information, assume the process may use most of the heap and only our allocations use it
+    for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++)
+    {
+        allocator->heapBudget[i] = memoryProperties->memoryHeaps[i].size / 100 * MEMORY_DEFAULT_BUDGET;
+        allocator->heapBudgetUsage[i] = allocator->heapBlockBytes[i];
+    }
+}
+
+VkDeviceSize get_vulkan_memory_heap_headroom(const MyRenderContext *context, uint32_t heapIndex)
+{
+    const MyMemoryAllocator *allocator = &context->memoryAllocator;
+
+    return allocator->heapBudget[heapIndex] > allocator->heapBudgetUsage[heapIndex] ? 
+        allocator->heapBudget[heapIndex] - allocator->heapBudgetUsage[heapIndex] : 0;
+}
+
+uint32_t get_vulkan_memory_stats(MyRenderContext *context, MyMemoryHeapStats *heapStats)
+{
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = &context->supportedFeatures.memoryProperties;
+
+    update_vulkan_memory_budget(context);
+    for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++)
+    {
+        heapStats[i].flags = memoryProperties->memoryHeaps[i].flags;
+        heapStats[i].size = memoryProperties->memoryHeaps[i].size;
+        heapStats[i].budget = context->memoryAllocator.heapBudget[i];
+        heapStats[i].usage = context->memoryAllocator.heapBudgetUsage[i];
+        heapStats[i].blockBytes = context->memoryAllocator.heapBlockBytes[i];
+        heapStats[i].usedBytes = context->memoryAllocator.heapUsedBytes[i];
+    }
+
+    return memoryProperties->memoryHeapCount;
+}
+
+void print_vulkan_memory_stats(MyRenderContext *context)
+{
+    MyMemoryHeapStats heapStats[VK_MAX_MEMORY_HEAPS];
+    uint32_t heapCount = get_vulkan_memory_stats(context, heapStats);
+
+    printf("Vulkan device memory (%s budget):\n", context->supportedFeatures.memoryBudgetSupport ? "driver" : "estimated");
+    for (uint32_t i = 0; i < heapCount; i++)
+    {
+        printf("\theap %u%s: size %llu MB, budget %llu MB, usage %llu MB, blocks %llu MB, used %llu MB\n", i, 
+            heapStats[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? " (device local)" : "",
+            (unsigned long long)(heapStats[i].size / (1024 * 1024)), 
+            (unsigned long long)(heapStats[i].budget / (1024 * 1024)),
+            (unsigned long long)(heapStats[i].usage / (1024 * 1024)),
+            (unsigned long long)(heapStats[i].blockBytes / (1024 * 1024)),
+            (unsigned long long)(heapStats[i].usedBytes / (1024 * 1024)));
+    }
+
+    printf("\t%u blocks (%u dedicated), %u allocations\n", context->memoryAllocator.blockCount, 
+        context->memoryAllocator.dedicatedCount, context->memoryAllocator.allocationCount);
+}
+
+uint32_t choose_vulkan_memory_type(const MyRenderContext *context, uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = &context->supportedFeatures.memoryProperties;
+    uint32_t bestIndex = UINT32_MAX;
+    uint32_t bestExtraCount = 0;
+    VkDeviceSize bestHeadroom = 0;
+
+    // Prefer the types without unrequested properties (do not waste BAR memory on device only resources or
+    // use cached memory for staging), then the heap with the most room left in its budget
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) 
+    {
+        VkMemoryPropertyFlags flags = memoryProperties->memoryTypes[i].propertyFlags;
+        uint32_t heapIndex = memoryProperties->memoryTypes[i].heapIndex;
+        VkDeviceSize headroom = get_vulkan_memory_heap_headroom(context, heapIndex);
+        uint32_t extraCount;
+
+        if (!(typeFilter & (1 << i)) || (flags & properties) != properties)
+        {
+            continue;
+        }
+
+        extraCount = count_extra_memory_properties(flags, properties);
+        if (bestIndex == UINT32_MAX || extraCount < bestExtraCount || (extraCount == bestExtraCount && headroom > bestHeadroom))
+        {
+            bestIndex = i;
+            bestExtraCount = extraCount;
+            bestHeadroom = headroom;
+        }
+    }
+
+    return bestIndex;
+}
+
+void create_vulkan_memory_allocator(MyRenderContext *context)
+{
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = &context->supportedFeatures.memoryProperties;
+    VkMemoryPropertyFlags directUploadProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    memset(&context->memoryAllocator, 0, sizeof(MyMemoryAllocator));
+    context->memoryAllocator.bufferImageGranularity = MAX(context->supportedFeatures.limits.bufferImageGranularity, 1);
+    context->memoryAllocator.directUploadHeapIndex = UINT32_MAX;
+    update_vulkan_memory_budget(context);
+
+    // Host visible device local heap is the whole VRAM with resizable BAR or on unified memory devices,
+    // otherwise a small 256MB window or nothing at all
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++)
+    {
+        uint32_t heapIndex = memoryProperties->memoryTypes[i].heapIndex;
+
+        if ((memoryProperties->memoryTypes[i].propertyFlags & directUploadProperties) == directUploadProperties &&
+            (context->memoryAllocator.directUploadHeapIndex == UINT32_MAX || 
+                memoryProperties->memoryHeaps[heapIndex].size > memoryProperties->memoryHeaps[context->memoryAllocator.directUploadHeapIndex].size))
+        {
+            context->memoryAllocator.directUploadHeapIndex = heapIndex;
+        }
+    }
+
+    if (context->memoryAllocator.directUploadHeapIndex != UINT32_MAX)
+    {
+        printf("Host visible device local heap %u: %llu MB\n", context->memoryAllocator.directUploadHeapIndex,
+            (unsigned long long)(memoryProperties->memoryHeaps[context->memoryAllocator.directUploadHeapIndex].size / (1024 * 1024)));
+    }
+}
+
+void destroy_vulkan_memory_allocator(MyRenderContext *context)
+{
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    {
+        while (context->memoryAllocator.blocks[i])
+        {
+            if (context->memoryAllocator.blocks[i]->allocationCount > 0)
+            {
+                fprintf(stderr, "Memory block of type %u destroyed with %u live allocations\n", i,
+                    context->memoryAllocator.blocks[i]->allocationCount);
+            }
+
+            destroy_memory_block(context, context->memoryAllocator.blocks[i]);
+        }
+    }
+}
+
+static MyMemoryBlock *allocate_from_memory_type(MyRenderContext *context, uint32_t memoryTypeIndex, VkDeviceSize size, 
+    VkDeviceSize alignment, const VkMemoryDedicatedAllocateInfo *dedicatedInfo, VkDeviceSize *offset)
+{
+    MyMemoryBlock *block;
+    uint32_t heapIndex = context->supportedFeatures.memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize blockSize = size, headroom;
+
+    if (!dedicatedInfo)
+    {
+        for (block = context->memoryAllocator.blocks[memoryTypeIndex]; block; block = block->next)
+        {
+            if (!block->dedicated && allocate_from_memory_block(block, size, alignment, offset))
+            {
+                return block;
+            }
+        }
+
+        // Keep blocks small compared to the heap, small heaps (like 256MB BAR window) should not be consumed by a single block
+        blockSize = MIN(MEMORY_BLOCK_SIZE, context->supportedFeatures.memoryProperties.memoryHeaps[heapIndex].size / 8);
+        blockSize = MAX(blockSize, size);
+    }
+
+    // Going over the budget makes the driver evict or fail, shrink the block to what is left instead
+    headroom = get_vulkan_memory_heap_headroom(context, heapIndex);
+    if (headroom < size)
+    {
+        return NULL;
+    }
+
+    if ((block = create_memory_block(context, memoryTypeIndex, MIN(blockSize, headroom), dedicatedInfo)) == NULL)
+    {
+        return NULL;
+    }
+
+    allocate_from_memory_block(block, size, alignment, offset);
+    return block;
+}
+
+uint8_t use_vulkan_dedicated_memory(const MyRenderContext *context, const VkMemoryDedicatedRequirements *dedicatedRequirements,
+    VkDeviceSize size)
+{
+    if (dedicatedRequirements->requiresDedicatedAllocation)
+    {
+        return VK_TRUE;
+    }
+
+    if (context->memoryAllocator.dedicatedPolicy == DEDICATED_POLICY_REQUIRED)
+    {
+        return VK_FALSE;
+    }
+
+    // Large resources would mostly waste a shared block anyway, and drivers may place dedicated memory better
+    return dedicatedRequirements->prefersDedicatedAllocation || size >= DEDICATED_ALLOCATION_SIZE;
+}
+
+int allocate_vulkan_memory(MyRenderContext *context, const VkMemoryRequirements *memRequirements, VkMemoryPropertyFlags properties,
+    uint8_t linear, const VkMemoryDedicatedAllocateInfo *dedicatedInfo, MyMemoryAllocation *allocation)
+{
+    MyMemoryBlock *block = NULL;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = memRequirements->size;
+    VkDeviceSize alignment = MAX(memRequirements->alignment, 1);
+    uint32_t failedTypes = 0;
+    uint32_t memoryTypeIndex;
+
+    // Linear and optimal resources must not share a bufferImageGranularity "page". Optimal resources take whole pages,
+    // so any linear neighbour is always placed on a different page.
+    if (!linear)
+    {
+        alignment = MAX(alignment, context->memoryAllocator.bufferImageGranularity);
+        size = ALIGN_UP(size, context->memoryAllocator.bufferImageGranularity);
+    }
+
+    while (!block)
+    {
+        memoryTypeIndex = choose_vulkan_memory_type(context, memRequirements->memoryTypeBits & ~failedTypes, properties);
+
+        if (memoryTypeIndex == UINT32_MAX)
+        {
+            // Device local memory is exhausted, system memory is slower for the GPU but still works
+            if (properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+            {
+                properties &= ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                continue;
+            }
+
+            fprintf(stderr, "Out of device memory, failed to allocate %llu bytes\n", (unsigned long long)size);
+            return VK_FALSE;
+        }
+
+        if ((block = allocate_from_memory_type(context, memoryTypeIndex, size, alignment, dedicatedInfo, &offset)) == NULL)
+        {
+            failedTypes |= 1u << memoryTypeIndex;
+        }
+    }
+
+    allocation->block = block;
+    allocation->memory = block->memory;
+    allocation->offset = offset;
+    allocation->size = size;
+    allocation->mapped = block->mapped ? (uint8_t *)block->mapped + offset : NULL;
+    context->memoryAllocator.allocationCount++;
+    context->memoryAllocator.heapUsedBytes[context->supportedFeatures.memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex] += size;
+    return VK_TRUE;
+}
+
+void free_vulkan_memory(MyRenderContext *context, const MyMemoryAllocation *allocation)
+{
+    MyMemoryBlock *block = allocation->block;
+
+    if (!block)
+    {
+        return;
+    }
+
+    release_to_memory_block(block, allocation->offset, allocation->size);
+    context->memoryAllocator.allocationCount--;
+    context->memoryAllocator.heapUsedBytes[context->supportedFeatures.memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex] -= allocation->size;
+
+    // Return empty blocks to the driver, but keep the last one of each memory type to avoid allocation ping-pong
+    if (block->allocationCount == 0 && 
+        (block->dedicated || block != context->memoryAllocator.blocks[block->memoryTypeIndex] || block->next))
+    {
+        destroy_memory_block(context, block);
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+
+// Heap budgets come from VK_EXT_memory_budget when supported, they are refreshed on every block allocation
+void update_vulkan_memory_budget(MyRenderContext *context);
+VkDeviceSize get_vulkan_memory_heap_headroom(const MyRenderContext *context, uint32_t heapIndex);
+uint32_t get_vulkan_memory_stats(MyRenderContext *context, MyMemoryHeapStats *heapStats);
+void print_vulkan_memory_stats(MyRenderContext *context);
+uint32_t choose_vulkan_memory_type(const MyRenderContext *context, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+void create_vulkan_memory_allocator(MyRenderContext *context);
+void destroy_vulkan_memory_allocator(MyRenderContext *context);
+uint8_t use_vulkan_dedicated_memory(const MyRenderContext *context, const VkMemoryDedicatedRequirements *dedicatedRequirements,
+    VkDeviceSize size);
+// dedicatedInfo is optional, if set the allocation gets its own VkDeviceMemory bound to the given resource
+int allocate_vulkan_memory(MyRenderContext *context, const VkMemoryRequirements *memRequirements, VkMemoryPropertyFlags properties,
+    uint8_t linear, const VkMemoryDedicatedAllocateInfo *dedicatedInfo, MyMemoryAllocation *allocation);
+void free_vulkan_memory(MyRenderContext *context, const MyMemoryAllocation *allocation);